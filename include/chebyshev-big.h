@@ -0,0 +1,125 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_BIG_H
+#define CHEBYSHEV_BIG_H
+
+
+/* Includes */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "chebyshev-pool.h"
+#include "chebyshev-primality-test.h"
+
+
+/**
+ * isprime_chebyshev() for n of any number of limbs: the integer, its
+ * Montgomery arithmetic, and the cyclic products the engines run on.
+ */
+
+/**
+ * Below this many limbs the schoolbook product is cheaper than splitting,
+ * so big_mul() only uses Karatsuba from here upwards.
+ */
+
+static const size_t BIG_KARATSUBA_THRESHOLD = 32;
+
+/**
+ * From this many limbs upwards big_mul() goes through big_mul_ntt(), whose
+ * O(m log m) transforms overtake Karatsuba between 4096 and 8192 limbs in
+ * BM_big_mul, the exact point varying with where m puts the power-of-2
+ * transform length.
+ */
+
+static const size_t BIG_NTT_THRESHOLD = 7168;
+
+/**
+ * @brief A nonnegative integer of any size, in 64-bit limbs, least
+ * significant first, with no zero limbs on top.
+ *
+ * It answers the same questions as wide<L>, so that the r search and the
+ * engines take either.
+ */
+
+typedef struct bignum
+{
+    bignum(const uint64_t* n, size_t limbs);
+
+    size_t   size()             const {return limb.size();}
+    bool     narrow()           const {return limb.size() <= 1;}
+    int      bits()             const;
+    bool     bit(int i)         const {return (limb[i/64] >> (i%64)) & 1;}
+    uint64_t mod(uint64_t s)    const;
+
+    std::vector<uint64_t> limb;
+} bignum;
+
+/**
+ * @brief Montgomery arithmetic modulo an odd n of k limbs, with R = 2^64(k+1).
+ *
+ * Residues are k limbs in [0, n), in Montgomery form as for montgomery.
+ * R has one limb more than n needs, so that any sum of fewer than 2^63
+ * products of residues is below nR and takes a single redc(), as with
+ * montgomery32. ninv is the low limb of -n^-1, all that each of redc()'s
+ * one-limb steps needs.
+ */
+
+typedef struct montgomery_big
+{
+    explicit montgomery_big(const bignum& n);
+
+    /**
+     * @brief Sum and difference of residues.
+     */
+
+    void add(uint64_t* out, const uint64_t* a, const uint64_t* b) const;
+    void sub(uint64_t* out, const uint64_t* a, const uint64_t* b) const;
+
+    /**
+     * @brief Sets out to t/R mod n, fully reduced, for t < nR of 2k+2
+     * limbs. t is overwritten.
+     */
+
+    void redc(uint64_t* out, uint64_t* t) const;
+
+    size_t                k;
+    std::vector<uint64_t> n;
+    uint64_t              ninv;     /* -n^-1 mod 2^64 */
+    std::vector<uint64_t> one;      /* R mod n */
+} montgomery_big;
+
+/**
+ * @brief The product of two m-limb integers, into out[0..2m), by
+ * Karatsuba's three-product split above BIG_KARATSUBA_THRESHOLD limbs, the
+ * schoolbook product below, and big_mul_ntt() from BIG_NTT_THRESHOLD. a and
+ * b may be the same (a square).
+ *
+ * The scratch area must hold big_mul_scratch(m) limbs.
+ */
+
+void   big_mul(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t m, uint64_t* scratch);
+size_t big_mul_scratch(size_t m);
+
+/**
+ * @brief big_mul() through the three-prime NTT of chebyshev-ntt.h, whose
+ * exact sums of limb products are carried into out[0..2m); the plan for m
+ * comes from thread_workspace().
+ */
+
+void   big_mul_ntt(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t m);
+
+/**
+ * @brief Whether Tn(x) = x^n (mod x^r - 1, n), with the products of each
+ * ladder step or matrix square run as one job of pool, or on the calling
+ * thread when pool is NULL.
+ *
+ * CHEBYSHEV_MATRIX and CHEBYSHEV_MATRIX_SPARSE both run the left-to-right
+ * matrix power of chebyshev_matrix_sparse(), whose squares hold five
+ * independent products against the ladder's two.
+ */
+
+bool chebyshev_congruence_big(const bignum& n, uint64_t r, chebyshev_engine engine,
+                              chebyshev_pool* pool);
+
+
+/* End Include Guards */
+#endif
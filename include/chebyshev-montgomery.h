@@ -0,0 +1,338 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_MONTGOMERY_H
+#define CHEBYSHEV_MONTGOMERY_H
+
+
+/* Includes */
+#include <stdint.h>
+#include <type_traits>
+#include "chebyshev-wide.h"
+#include "primality-test-baseline.h"
+
+
+/**
+ * @brief A word in [0, n) for the n of some montgomery.
+ *
+ * Only montgomery makes a nonzero one, from its own results (unit(),
+ * lift(), add(), mul(), reduce() ...), so whatever takes a residue can
+ * rely on it being reduced and never reduces it again. It is a single
+ * trivially copyable word, so the vector kernels and ntt_plan take an array
+ * of them as uint64_t through data(), which is where the type is left.
+ */
+
+typedef struct residue
+{
+    residue() = default;
+    uint64_t value() const{return v;}
+
+    bool operator==(residue b) const{return v == b.v;}
+    bool operator!=(residue b) const{return v != b.v;}
+
+private:
+    explicit residue(uint64_t v) : v(v) {}
+    uint64_t v;
+
+    friend struct montgomery;
+} residue;
+
+static_assert(std::is_trivially_copyable<residue>::value && sizeof(residue) == sizeof(uint64_t),
+              "residue must be one plain word");
+
+static inline uint64_t*       data(residue*       a){return reinterpret_cast<uint64_t*      >(a);}
+static inline const uint64_t* data(const residue* a){return reinterpret_cast<const uint64_t*>(a);}
+
+
+/**
+ * @brief Montgomery arithmetic modulo an odd 64-bit integer n, with R = 2^64.
+ *
+ * A residue a is represented by aR mod n. Sums and differences work on that
+ * form unchanged, and
+ *
+ *     $$mul(aR, bR) = abR \pmod n$$
+ *
+ * needs only multiplications, so once operands are converted with to(), a
+ * whole computation runs without a hardware divide until from() converts
+ * the result back.
+ *
+ * It is a gaIModCtx, so one built for n also serves gaIIsPrimeStrongFermatCtx()
+ * and the other *Ctx functions, and one can be built from a context already
+ * set up for the same n.
+ */
+
+typedef struct montgomery : gaIModCtx
+{
+    typedef residue word;
+
+    explicit montgomery(uint64_t n)           {gaIModCtxInit(this, n);}
+    explicit montgomery(const gaIModCtx& ctx) : gaIModCtx(ctx) {}
+
+    /**
+     * @brief Computes t/R mod n for any t < nR, fully reduced.
+     */
+
+    uint64_t redc(unsigned __int128 t) const{
+        uint64_t m  = (uint64_t)t * ninv;
+        uint64_t th = (uint64_t)(t >> 64);
+        uint64_t mh = (uint64_t)(((unsigned __int128)m * n) >> 64);
+        return th >= mh ? th-mh : th-mh+n;
+    }
+
+    /**
+     * @brief Sum, difference, double and half-sum of residues.
+     *
+     * Operands and results all lie in [0, n), as does every word this struct
+     * hands out (one, r2, to(), mul(), redc()), so unlike gaIAddMod() and
+     * gaISubMod() these never divide to reduce their inputs first. The
+     * wrap-around is added back through a mask rather than a branch, since
+     * whether it happens is data dependent; avg() needs n odd.
+     */
+
+    uint64_t add (uint64_t a, uint64_t b) const{return a-(n-b) + (n & (0-(uint64_t)(a < n-b)));}
+    uint64_t sub (uint64_t a, uint64_t b) const{return a-b     + (n & (0-(uint64_t)(a < b  )));}
+    uint64_t dbl (uint64_t a)             const{return add(a, a);}
+    uint64_t avg (uint64_t a, uint64_t b) const{
+        uint64_t s = add(a, b);
+        return (s >> 1) + (((n >> 1) + 1) & (0-(s & 1)));
+    }
+
+    /**
+     * @brief Computes (c*2^128 + t)/R mod n.
+     *
+     * This reduces a sum of raw products of Montgomery-form operands, with
+     * its carries out of 128 bits counted in c, to the Montgomery form of
+     * the sum. It requires c < n, which holds for any sum of fewer than n
+     * such products.
+     */
+
+    uint64_t redc(uint64_t c, unsigned __int128 t) const{
+        uint64_t hi = (uint64_t)(t >> 64);
+        uint64_t lo = (uint64_t) t;
+
+        /* (c*2^64 + hi) mod n is redc() of it times R^2, and lo/R is redc(lo). */
+        return add(mul(redc(((unsigned __int128)c << 64) | hi), r2), redc(lo));
+    }
+
+    uint64_t mul (uint64_t a, uint64_t b) const{return redc((unsigned __int128)a * b);}
+    uint64_t to  (uint64_t a)             const{return mul(a, r2);}
+    uint64_t from(uint64_t a)             const{return redc(a);}
+
+    /**
+     * @brief The operations above on residue, the word of polynomial and
+     * matrix: unit() is 1 and lift() any a in Montgomery form, and
+     * reduce() is redc(c, t).
+     */
+
+    residue unit()                                 const{return residue(one);}
+    residue lift  (uint64_t a)                     const{return residue(to(a));}
+    residue add   (residue a, residue b)           const{return residue(add(a.v, b.v));}
+    residue sub   (residue a, residue b)           const{return residue(sub(a.v, b.v));}
+    residue dbl   (residue a)                      const{return residue(dbl(a.v));}
+    residue avg   (residue a, residue b)           const{return residue(avg(a.v, b.v));}
+    residue mul   (residue a, residue b)           const{return residue(mul(a.v, b.v));}
+    residue reduce(uint64_t c, unsigned __int128 t) const{return residue(redc(c, t));}
+    uint64_t from (residue a)                      const{return redc(a.v);}
+
+} montgomery;
+
+
+/**
+ * @brief montgomery for an odd n < 2^32, on 32-bit words.
+ *
+ * R stays 2^64, but residues aR mod n < 2^32 fit a 32-bit word, a product
+ * of two fits 64 bits, and a sum of fewer than n such products stays below
+ * nR, so a single redc() reduces it.
+ */
+
+typedef struct montgomery32 : montgomery
+{
+    typedef uint32_t word;
+
+    explicit montgomery32(uint32_t n) : montgomery(n) {}
+
+    uint32_t unit() const{return (uint32_t)one;}
+} montgomery32;
+
+
+/**
+ * @brief montgomery for an odd n of up to L limbs, with R = 2^64L.
+ *
+ * Residues are wide<L> in [0, n), as for montgomery. mul() is the CIOS form
+ * of Montgomery's product: it interleaves the L rows of the schoolbook
+ * product with L one-limb reductions, so the running sum never grows past
+ * L+2 limbs, and each reduction needs only the low limb of the inverse;
+ * ninv here is that limb of -n^-1.
+ */
+
+template<int L> struct montgomery_wide
+{
+    typedef wide<L> word;
+
+    explicit montgomery_wide(const wide<L>& n) : n(n){
+        // Newton's iteration, from the 3 bits x = n gets right for odd n
+        uint64_t x = n.limb[0];
+        for(int i = 0; i < 5; i++){
+            x *= 2 - n.limb[0]*x;
+        }
+        ninv = 0-x;
+
+        // R mod n: 2^(b-1) < n for b-bit n, doubled up to 2^64L; then R^2
+        const int b = n.bits();
+        one = wide<L>(0);
+        one.limb[(b-1)/64] = 1ULL << ((b-1)%64);
+        for(int i = b-1; i < 64*L; i++){
+            one = dbl(one);
+        }
+        r2 = one;
+        for(int i = 0; i < 64*L; i++){
+            r2 = dbl(r2);
+        }
+    }
+
+    /**
+     * @brief s, or s - n when s + carry*R >= n; for s + carry*R < 2n.
+     */
+
+    wide<L> cut(const wide<L>& s, unsigned char carry) const{
+        wide<L>        d;
+        unsigned char  borrow = wide_sub(d, s, n);
+        const uint64_t keep   = 0-(uint64_t)(borrow & !carry);
+        for(int i = 0; i < L; i++){
+            d.limb[i] ^= (d.limb[i] ^ s.limb[i]) & keep;
+        }
+        return d;
+    }
+
+    /**
+     * @brief Sum, difference, double and half-sum of residues, all in [0, n).
+     */
+
+    wide<L> add(const wide<L>& a, const wide<L>& b) const{
+        wide<L>       s;
+        unsigned char carry = wide_add(s, a, b);
+        return cut(s, carry);
+    }
+
+    wide<L> sub(const wide<L>& a, const wide<L>& b) const{
+        wide<L>        d, m;
+        const uint64_t mask = 0-(uint64_t)wide_sub(d, a, b);
+        for(int i = 0; i < L; i++){
+            m.limb[i] = n.limb[i] & mask;
+        }
+        wide_add(d, d, m);
+        return d;
+    }
+
+    wide<L> dbl(const wide<L>& a) const{return add(a, a);}
+
+    wide<L> avg(const wide<L>& a, const wide<L>& b) const{
+        wide<L>        s = add(a, b), m;
+        const uint64_t mask = 0-(s.limb[0] & 1);
+        for(int i = 0; i < L; i++){
+            m.limb[i] = n.limb[i] & mask;
+        }
+        const uint64_t carry = wide_add(s, s, m);
+        s = wide_shr(s, 1);
+        s.limb[L-1] |= carry << 63;
+        return s;
+    }
+
+    /**
+     * @brief Computes t/R mod n for a 2L-limb t < nR, fully reduced. t is
+     * overwritten.
+     */
+
+    wide<L> redc(uint64_t* t) const{
+        unsigned char top = 0;
+        for(int i = 0; i < L; i++){
+            const uint64_t m = t[i]*ninv;
+            uint64_t       k = 0;
+            for(int j = 0; j < L; j++){
+                unsigned __int128 p = (unsigned __int128)m * n.limb[j] + t[i+j] + k;
+                t[i+j] = (uint64_t)p;
+                k      = (uint64_t)(p >> 64);
+            }
+            unsigned char carry = 0;
+            t[i+L] = limb_add(t[i+L], k, carry);
+            for(int j = i+L+1; j < 2*L; j++){
+                t[j] = limb_add(t[j], 0, carry);
+            }
+            top += carry;
+        }
+
+        wide<L> s;
+        for(int i = 0; i < L; i++){
+            s.limb[i] = t[L+i];
+        }
+        return cut(s, top);
+    }
+
+    /**
+     * @brief Computes (c*R^2 + t)/R mod n for the 2L-limb t, as
+     * montgomery::redc(c, t) does for one limb; requires c < n. t is
+     * overwritten.
+     */
+
+    wide<L> redc(uint64_t c, uint64_t* t) const{
+        uint64_t hi[2*L] = {0}, lo[2*L] = {0};
+        for(int i = 0; i < L; i++){
+            hi[i] = t[L+i];
+            lo[i] = t[i];
+        }
+        hi[L] = c;
+        return add(mul(redc(hi), r2), redc(lo));
+    }
+
+    wide<L> mul(const wide<L>& a, const wide<L>& b) const{
+        uint64_t t[L+2] = {0};
+        for(int i = 0; i < L; i++){
+            uint64_t          k = 0;
+            unsigned __int128 p;
+            for(int j = 0; j < L; j++){
+                p    = (unsigned __int128)a.limb[j] * b.limb[i] + t[j] + k;
+                t[j] = (uint64_t)p;
+                k    = (uint64_t)(p >> 64);
+            }
+            p      = (unsigned __int128)t[L] + k;
+            t[L]   = (uint64_t)p;
+            t[L+1] = (uint64_t)(p >> 64);
+
+            // add m*n, which clears t[0], and shift down a limb
+            const uint64_t m = t[0]*ninv;
+            p = (unsigned __int128)m * n.limb[0] + t[0];
+            k = (uint64_t)(p >> 64);
+            for(int j = 1; j < L; j++){
+                p      = (unsigned __int128)m * n.limb[j] + t[j] + k;
+                t[j-1] = (uint64_t)p;
+                k      = (uint64_t)(p >> 64);
+            }
+            p      = (unsigned __int128)t[L] + k;
+            t[L-1] = (uint64_t)p;
+            t[L]   = t[L+1] + (uint64_t)(p >> 64);
+        }
+
+        wide<L> s;
+        for(int i = 0; i < L; i++){
+            s.limb[i] = t[i];
+        }
+        return cut(s, (unsigned char)t[L]);
+    }
+
+    wide<L> unit()                 const{return one;}
+    wide<L> to  (const wide<L>& a) const{return mul(a, r2);}
+    wide<L> from(const wide<L>& a) const{
+        uint64_t t[2*L] = {0};
+        for(int i = 0; i < L; i++){
+            t[i] = a.limb[i];
+        }
+        return redc(t);
+    }
+
+    wide<L>  n;
+    uint64_t ninv;      /* -n^-1 mod 2^64 */
+    wide<L>  one;       /* R   mod n */
+    wide<L>  r2;        /* R^2 mod n */
+};
+
+
+/* End Include Guards */
+#endif
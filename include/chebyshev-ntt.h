@@ -0,0 +1,138 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_NTT_H
+#define CHEBYSHEV_NTT_H
+
+
+/* Includes */
+#include <stdint.h>
+#include <vector>
+#include "chebyshev-montgomery.h"
+
+
+/* Defines */
+
+/**
+ * Number of NTT primes. Each is just below 2^62, so their product exceeds
+ * 2^185 and bounds any exactly-rebuilt coefficient sum of up to 2^47 terms
+ * of the form a*b with a, b < 2^64.
+ */
+
+#define NTT_NUM_PRIMES 3
+
+
+/**
+ * @brief A fixed multiplier w mod p with its Shoup quotient
+ *
+ *     $$q = \lfloor w 2^{64} / p \rfloor$$
+ *
+ * so that a*w mod p, for any 64-bit a, costs a high and two low
+ * multiplications and one conditional subtraction.
+ */
+
+typedef struct ntt_shoup
+{
+    uint64_t w;
+    uint64_t q;
+} ntt_shoup;
+
+
+/**
+ * @brief Number-theoretic-transform multiplier for the ring
+ *
+ *     $$Z_n[x] / (x^r - 1)$$
+ *
+ * Operands are transformed modulo three NTT-friendly primes. Products and
+ * sums of products are formed pointwise in the transform domain, and the
+ * exact integer coefficients are rebuilt by CRT (Garner's algorithm) before
+ * the final reduction mod n. Coefficients are taken and returned in the
+ * Montgomery form of the given context. Because the transform is linear, a
+ * sum such as A*B + C*D costs a single inverse transform, and a transformed
+ * operand can be reused in as many products as it appears in.
+ *
+ * A transformed operand occupies words() 64-bit words.
+ */
+
+typedef struct ntt_plan
+{
+    ntt_plan(uint64_t r, const montgomery& mont);
+
+    /**
+     * @brief A plan for integer products of r-limb operands, see product();
+     * it takes no n, and its mod-n constants are left for a rebind().
+     */
+
+    explicit ntt_plan(uint64_t r);
+
+    uint64_t words() const {return NTT_NUM_PRIMES*L;}
+
+    /**
+     * @brief Switch to another modulus n, keeping r and the twiddles.
+     *
+     * Only the two CRT constants depend on n, so a plan can be reused across
+     * tests of the same r without reallocating.
+     */
+
+    void rebind(const montgomery& mont);
+
+    /**
+     * @brief Transform the r coefficients a[] (reduced mod n) into A[].
+     */
+
+    void forward(uint64_t* A, const uint64_t* a) const;
+
+    /**
+     * @brief Pointwise C = A*B, or C += A*B for muladd().
+     */
+
+    void mul    (uint64_t* C, const uint64_t* A, const uint64_t* B) const;
+    void muladd (uint64_t* C, const uint64_t* A, const uint64_t* B) const;
+
+    /**
+     * @brief Inverse-transform C[] (which is clobbered), fold it mod x^r - 1
+     *        and write the r coefficients, reduced mod n, to c[].
+     *
+     * The transform of a product of Montgomery-form operands holds abR^2;
+     * the reduction mod n divides out the extra R.
+     */
+
+    void inverse(uint64_t* c, uint64_t* C) const;
+
+    /**
+     * @brief The integer product of the r-limb a and b, a square when b is
+     *        a, in two steps: product() for each prime i leaves the product
+     *        of the limb sequences mod p_i in C[], and carry() rebuilds
+     *        their exact sums, below r 2^128 < p1 p2 p3, and carries them
+     *        into the 2r limbs c[].
+     *
+     * The primes touch disjoint words of C[] and T[], words() each, so they
+     * may run on different threads. Any plan of this r will do; the limbs
+     * go in as they are, not reduced mod n.
+     */
+
+    void product(uint64_t* C, uint64_t* T, const uint64_t* a, const uint64_t* b, int i) const;
+    void carry  (uint64_t* c, const uint64_t* C) const;
+
+    uint64_t   r;
+    montgomery mont;
+    uint64_t   L;           /* Transform length, a power of 2 >= 2r-1 */
+    uint64_t   logL;
+    uint64_t   p1modn;      /* p1    mod n */
+    uint64_t   p12modn;     /* p1*p2 mod n */
+
+    /**
+     * Per-prime twiddles w^k and w^-k, k < L/2, and 1/(LR), all fixed across
+     * the transforms of a plan and so kept as Shoup multipliers.
+     */
+
+    std::vector <ntt_shoup> w   [NTT_NUM_PRIMES];
+    std::vector <ntt_shoup> winv[NTT_NUM_PRIMES];
+    ntt_shoup               Linv[NTT_NUM_PRIMES];
+
+private:
+    void forward (uint64_t* X, const uint64_t* a, int i) const;
+    void backward(uint64_t* X, int i) const;
+} ntt_plan;
+
+
+/* End Include Guards */
+#endif
@@ -0,0 +1,73 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_ORACLE_H
+#define CHEBYSHEV_ORACLE_H
+
+
+/* Includes */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "chebyshev-wide.h"
+
+
+/* Defines */
+
+/**
+ * Largest sieving prime the oracle keeps, i.e. it sieves ranges below
+ * about 2^52; its odd primes take 16 MiB.
+ */
+
+#define ORACLE_MAX_ROOT (1ULL << 26)
+
+/**
+ * Odd numbers per sieve segment: one bit each, 32 KiB, so a segment stays
+ * in L1 while every sieving prime crosses it.
+ */
+
+#define ORACLE_SEGMENT_BITS (1ULL << 18)
+
+
+/**
+ * @brief Ground truth to check isprime_chebyshev() against.
+ *
+ * A range is sieved, a bit-packed segment of odd numbers at a time, by the
+ * odd primes up to the square root of the end of the range, as long as it
+ * is long enough to repay crossing them all off once; shorter ranges, and
+ * ranges past ORACLE_MAX_ROOT^2, get gaIIsPrime() on each number instead.
+ *
+ * The sieving primes are found once, for numbers below the hi given to the
+ * constructor, and shared by every range() after.
+ */
+
+typedef struct prime_oracle
+{
+    explicit prime_oracle(uint64_t hi);
+
+    /**
+     * @brief Sets prime[i] to whether lo+i is prime, for lo+i < hi.
+     */
+
+    void range(uint64_t lo, uint64_t hi, uint8_t* prime) const;
+
+    /**
+     * @brief Whether range(lo, hi) sieves rather than tests each number.
+     */
+
+    bool sieves(uint64_t lo, uint64_t hi) const;
+
+    uint64_t              root;     /* sieving primes go up to here */
+    std::vector<uint32_t> primes;   /* odd primes <= root */
+} prime_oracle;
+
+/**
+ * @brief gaIIsPrime() for n of L 64-bit limbs, defined for wide128 and
+ * wide256: the same trial division by 3 to 79 and BPSW test, on
+ * montgomery_wide<L>. Below 2^64 it is gaIIsPrime() itself; above, like
+ * any BPSW test, it has no known failures but no proof of having none.
+ */
+
+template<int L> int gaIIsPrime(const wide<L>& n);
+
+
+/* End Include Guards */
+#endif
@@ -0,0 +1,73 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_POOL_H
+#define CHEBYSHEV_POOL_H
+
+
+/* Includes */
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief Part i of the job that context describes, for a chebyshev_pool.
+ */
+
+typedef void (*chebyshev_task_fn)(void* context, size_t i);
+
+/**
+ * @brief Worker threads for the parallel parts of a single test.
+ *
+ * run() is a parallel for loop: the parts of a job go to the workers and
+ * the calling thread alike, first come first served, and it returns once
+ * all of them are done. A job here is the independent polynomial products
+ * of one ladder step or matrix square, each long enough at the sizes that
+ * use a pool to repay waking the workers.
+ *
+ * A pool is for one calling thread at a time.
+ */
+
+typedef struct chebyshev_pool
+{
+    /**
+     * @brief Starts threads-1 workers, so that run() uses threads threads
+     * counting the caller; one per core when 0.
+     */
+
+    explicit chebyshev_pool(unsigned threads);
+    ~chebyshev_pool();
+
+    /**
+     * @brief Runs task(context, i) for every i < count and waits for them.
+     */
+
+    void run(chebyshev_task_fn task, void* context, size_t count);
+
+    unsigned threads() const {return workers.size()+1;}
+
+    std::vector<std::thread> workers;
+
+    std::mutex              lock;           /* guards the fields below */
+    std::condition_variable wake, done;
+    chebyshev_task_fn       task    = NULL;
+    void*                   context = NULL;
+    size_t                  count   = 0;
+    size_t                  next    = 0;    /* next part to take */
+    size_t                  left    = 0;    /* parts not finished yet */
+    uint64_t                job     = 0;    /* bumped to start a job */
+    bool                    stop    = false;
+
+private:
+    void work();
+    void take();
+
+    chebyshev_pool(const chebyshev_pool&);
+    chebyshev_pool& operator=(const chebyshev_pool&);
+} chebyshev_pool;
+
+
+/* End Include Guards */
+#endif
@@ -0,0 +1,141 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_PRIMALITY_TEST_H
+#define CHEBYSHEV_PRIMALITY_TEST_H
+
+
+/* Includes */
+#include <stddef.h>
+#include <stdint.h>
+#include "chebyshev-wide.h"
+
+
+/**
+ * How isprime_chebyshev() computes Tn(x) mod (x^r - 1, n).
+ */
+
+enum chebyshev_engine
+{
+    CHEBYSHEV_MATRIX,        /* Powers of the 2x2 companion matrix */
+    CHEBYSHEV_MATRIX_SPARSE, /* Same, left-to-right with a sparse base step */
+    CHEBYSHEV_LADDER         /* Doubling ladder on (T_k, T_{k+1}) */
+};
+
+bool isprime_chebyshev(uint64_t n, chebyshev_engine engine = CHEBYSHEV_LADDER);
+
+/**
+ * isprime_chebyshev() for n of L 64-bit limbs, defined for wide128 and
+ * wide256. n below 2^64 takes the one-word test; above, the ladder runs on
+ * montgomery_wide<L>, with r picked past 173 where the small primes run out.
+ */
+
+template<int L> bool isprime_chebyshev(const wide<L>& n);
+
+/**
+ * isprime_chebyshev() for n of any size, given as its limbs n[0..limbs),
+ * least significant first. Up to four limbs it is the one-word or wide<L>
+ * test. Past that the coefficients are limb arrays multiplied by Kronecker
+ * substitution and Karatsuba, see chebyshev-big.h, and the independent
+ * products of each ladder step or matrix square run on pool's threads, or
+ * on the calling thread alone when pool is NULL.
+ */
+
+struct chebyshev_pool;
+
+bool isprime_chebyshev_big(const uint64_t* n, size_t limbs,
+                           chebyshev_engine engine = CHEBYSHEV_LADDER, chebyshev_pool* pool = NULL);
+
+/**
+ * Sets out[i] to isprime_chebyshev(n[i]) for i < count. The n are grouped
+ * by r, so that each group does its setup once and, where the CPU has the
+ * kernel, runs SIMD_LADDER_LANES ladders at a time in vector lanes.
+ */
+
+void isprime_chebyshev_batch(const uint64_t* n, size_t count, uint8_t* out);
+
+/**
+ * Sets out[i] to isprime_chebyshev(lo+i) for i < count, as
+ * isprime_chebyshev_batch() does, with r picked by a chebyshev_selector.
+ */
+
+void isprime_chebyshev_range(uint64_t lo, size_t count, uint8_t* out);
+
+/**
+ * Number of small primes isprime_chebyshev() picks r from: 3 to 173, which
+ * always holds an r for n < 2^64.
+ */
+
+#define CHEBYSHEV_PRIMES 39
+
+/**
+ * Residues a chebyshev_selector keeps: CHEBYSHEV_PRIMES rounded up to a
+ * whole number of vector registers.
+ */
+
+#define CHEBYSHEV_SELECTOR_WIDTH 64
+
+/**
+ * @brief The r search of isprime_chebyshev() for consecutive n, free of
+ * divisions.
+ *
+ * It keeps n mod each of the small primes and steps them all with an add
+ * and a wrap. For prime s, n^2 = 1 (mod s) just when n = +-1 (mod s), so
+ * the search takes a compare or two per prime, up to the first prime that
+ * divides n or will do as r.
+ */
+
+typedef struct chebyshev_selector
+{
+    explicit chebyshev_selector(uint64_t n);
+
+    /**
+     * @brief Returns 1 or 0 when n is settled as prime or composite, or -1
+     * with r set to the r isprime_chebyshev() would use for n.
+     */
+
+    int  select(uint64_t& r) const;
+
+    /**
+     * @brief Moves on to n+1.
+     */
+
+    void next();
+
+    uint64_t n;
+    alignas(64) uint8_t residue[CHEBYSHEV_SELECTOR_WIDTH];  /* n mod each of the primes */
+} chebyshev_selector;
+
+/**
+ * @brief Receives the results of chebyshev_sweep() a chunk at a time, in
+ * increasing order of lo: prime[i] tells whether lo+i is prime, i < count.
+ */
+
+typedef void (*chebyshev_sweep_fn)(uint64_t lo, const uint8_t* prime, size_t count, void* context);
+
+/**
+ * @brief What a chebyshev_sweep() did, and how fast.
+ */
+
+typedef struct chebyshev_sweep_stats
+{
+    uint64_t numbers;
+    uint64_t primes;
+    unsigned threads;
+    double   seconds;
+} chebyshev_sweep_stats;
+
+/**
+ * @brief Tests every n in [lo, hi) with isprime_chebyshev_range().
+ *
+ * The range is cut into fixed-size chunks and run on threads threads, one
+ * per core when 0. Each thread works through its own run of chunks and,
+ * once out, steals the back half of the largest run left, so that threads
+ * stay busy however unevenly the cost of a test varies across the range.
+ * Results reach emit, if not NULL, on the calling thread and in order.
+ */
+
+chebyshev_sweep_stats chebyshev_sweep(uint64_t lo, uint64_t hi, unsigned threads,
+                                      chebyshev_sweep_fn emit, void* context);
+
+
+/* End Include Guards */
+#endif
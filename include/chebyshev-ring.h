@@ -0,0 +1,914 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_RING_H
+#define CHEBYSHEV_RING_H
+
+
+/* Includes */
+#include <stdint.h>
+#include <array>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "chebyshev-montgomery.h"
+#include "chebyshev-ntt.h"
+#include "chebyshev-simd.h"
+#include "primality-test-baseline.h"
+
+
+/**
+ * Arithmetic in Z_n[x]/(x^r - 1) under the engines of isprime_chebyshev():
+ * the per-thread workspace, the cyclic product kernels, and the polynomial
+ * and 2x2 matrix types built on them.
+ */
+
+/**
+ * Below this many coefficients the schoolbook product is cheaper than
+ * splitting, so polynomial::operator* only uses Karatsuba from here upwards.
+ */
+
+static const uint64_t KARATSUBA_THRESHOLD = 64;
+
+/**
+ * From these r upwards the cyclic products go through the vector kernels of
+ * chebyshev-simd.h when the CPU has them. Below, the fully unrolled scalar
+ * kernels (and the symmetric square) are as fast, since the per-coefficient
+ * reductions, which both do in scalar code, dominate there.
+ */
+
+static const uint64_t SIMD32_THRESHOLD = 13;
+static const uint64_t SIMD52_THRESHOLD = 7;
+
+/**
+ * Per-thread store of the heap memory a test needs: blocks handed back with
+ * give() wait on a free list for their size until the next take() of that
+ * size, and NTT plans are kept per r and rebound to each new n, or shared
+ * as they are by the integer products of chebyshev-big.h. The first
+ * test of a given r sizes it; after that a test allocates nothing.
+ *
+ * Blocks start on a 64-byte (cache line) boundary.
+ */
+
+typedef struct workspace
+{
+    workspace() {}
+    ~workspace(){
+        for(size_t i = 0; i < free.size(); i++){
+            while(void* block = free[i].second){
+                free[i].second = *(void**)block;
+                ::operator delete(((void**)block)[-1]);
+            }
+        }
+        for(size_t i = 0; i < plans.size(); i++){
+            delete plans[i];
+        }
+    }
+
+    void* take(size_t bytes){
+        void*& head = list(bytes);
+        if(void* block = head){
+            head = *(void**)block;
+            return block;
+        }
+
+        // round up past the allocation and keep where it started just below
+        void*  raw   = ::operator new((bytes < sizeof(void*) ? sizeof(void*) : bytes) + 64);
+        void** block = (void**)(((uintptr_t)raw + 64) & ~(uintptr_t)63);
+        block[-1] = raw;
+        return block;
+    }
+
+    void give(void* block, size_t bytes){
+        void*& head = list(bytes);
+        *(void**)block = head;
+        head = block;
+    }
+
+    const ntt_plan* plan(uint64_t r, const montgomery& mont){
+        for(size_t i = 0; i < plans.size(); i++){
+            if(plans[i]->r == r){
+                plans[i]->rebind(mont);
+                return plans[i];
+            }
+        }
+        plans.push_back(new ntt_plan(r, mont));
+        return plans.back();
+    }
+
+    // for integer products, which never read the mod-n constants
+    const ntt_plan* plan(uint64_t r){
+        for(size_t i = 0; i < plans.size(); i++){
+            if(plans[i]->r == r){
+                return plans[i];
+            }
+        }
+        plans.push_back(new ntt_plan(r));
+        return plans.back();
+    }
+
+    // free blocks are chained through their first word
+    void*& list(size_t bytes){
+        for(size_t i = 0; i < free.size(); i++){
+            if(free[i].first == bytes){
+                return free[i].second;
+            }
+        }
+        free.push_back(std::make_pair(bytes, (void*)NULL));
+        return free.back().second;
+    }
+
+    std::vector <std::pair<size_t, void*> > free;
+    std::vector <ntt_plan*>                 plans;
+
+private:
+    workspace(const workspace&);
+    workspace& operator=(const workspace&);
+} workspace;
+
+inline workspace& thread_workspace(){
+    static thread_local workspace w;
+    return w;
+}
+
+/**
+ * Allocator drawing on thread_workspace(), for the containers a test builds
+ * and drops over and over.
+ */
+
+template<typename T> struct pooled
+{
+    typedef T value_type;
+
+    pooled() {}
+    template<typename U> pooled(const pooled<U>&) {}
+
+    T*   allocate  (size_t k)          {return (T*)thread_workspace().take(k*sizeof(T));}
+    void deallocate(T* block, size_t k){thread_workspace().give(block, k*sizeof(T));}
+};
+
+template<typename T, typename U>
+static inline bool operator==(const pooled<T>&, const pooled<U>&){return true; }
+template<typename T, typename U>
+static inline bool operator!=(const pooled<T>&, const pooled<U>&){return false;}
+
+/**
+ * Scratch space of N words of type T, on the stack when N is known at compile
+ * time and from thread_workspace() when it is 0 (meaning "sized at run time").
+ */
+
+template<uint64_t N, typename T = uint64_t> struct buffer
+{
+    explicit buffer(uint64_t) {}
+    T* data() {return w;}
+    T  w[N];
+};
+
+template<typename T> struct buffer<0, T>
+{
+    explicit buffer(uint64_t n) : n(n), w((T*)thread_workspace().take(n*sizeof(T))) {}
+    ~buffer() {thread_workspace().give(w, n*sizeof(T));}
+    T*        data() {return w;}
+    uint64_t  n;
+    T*        w;
+
+private:
+    buffer(const buffer&);
+    buffer& operator=(const buffer&);
+};
+
+/**
+ * Lazy accumulation: adds the raw 128-bit product a*b to the running sum t,
+ * counting carries out of t in c. The sum is reduced once, with
+ * montgomery::redc(c, t), after all of its products have been added.
+ */
+
+static inline void mac(unsigned __int128& t, uint64_t& c, uint64_t a, uint64_t b){
+    unsigned __int128 ab = (unsigned __int128)a * b;
+    t += ab;
+    c += t < ab;
+}
+
+static inline void mac(unsigned __int128& t, uint64_t& c, residue a, residue b){
+    mac(t, c, a.value(), b.value());
+}
+
+/**
+ * Doubles the lazily accumulated sum c*2^128 + t.
+ */
+
+static inline void dbl(unsigned __int128& t, uint64_t& c){
+    c  = 2*c + (uint64_t)(t >> 127);
+    t <<= 1;
+}
+
+/**
+ * Cyclic product mod x^r - 1 with one reduction per output coefficient.
+ *
+ *     out[k] = sum_{i<=k} a[i] b[k-i]  +  sum_{i>k} a[i] b[k+r-i]
+ *
+ * Splitting each sum at the wrap-around point keeps index arithmetic free of
+ * a % r.
+ */
+
+template<uint64_t R>
+static void mul_cyclic(residue* out, const residue* a, const residue* b,
+                       uint64_t r, const montgomery& m){
+    if(R){r = R;}// constant trip counts for the specializations
+    for(uint64_t k = 0; k < r; k++){
+        unsigned __int128 t = 0;
+        uint64_t          c = 0;
+        for(uint64_t i = 0; i <= k; i++){
+            mac(t, c, a[i], b[k-i]);
+        }
+        for(uint64_t i = k+1; i < r; i++){
+            mac(t, c, a[i], b[k+r-i]);
+        }
+        out[k] = m.reduce(c, t);
+    }
+}
+
+/**
+ * Fused cyclic a*b + u*v mod x^r - 1. Both convolutions feed the same lazy
+ * sum, so each output coefficient costs one reduction instead of three
+ * (two products and an add), and no intermediate polynomial is written.
+ */
+
+template<uint64_t R>
+static void muladd_cyclic(residue* out, const residue* a, const residue* b,
+                          const residue* u, const residue* v,
+                          uint64_t r, const montgomery& m){
+    if(R){r = R;}
+    for(uint64_t k = 0; k < r; k++){
+        unsigned __int128 t = 0;
+        uint64_t          c = 0;
+        for(uint64_t i = 0; i <= k; i++){
+            mac(t, c, a[i], b[k-i]);
+            mac(t, c, u[i], v[k-i]);
+        }
+        for(uint64_t i = k+1; i < r; i++){
+            mac(t, c, a[i], b[k+r-i]);
+            mac(t, c, u[i], v[k+r-i]);
+        }
+        out[k] = m.reduce(c, t);
+    }
+}
+
+/**
+ * Cyclic square mod x^r - 1.
+ *
+ * Each off-diagonal product a[i] a[j] appears twice in out[(i+j) % r], so
+ * only the pairs i < j are accumulated and the sum doubled. Because r is odd
+ * there is exactly one diagonal term per output, a[k/2]^2 or a[(k+r)/2]^2.
+ */
+
+template<uint64_t R>
+static void sqr_cyclic(residue* out, const residue* a, uint64_t r,
+                       const montgomery& m){
+    if(R){r = R;}
+    for(uint64_t k = 0; k < r; k++){
+        unsigned __int128 t = 0;
+        uint64_t          c = 0;
+        for(uint64_t i = 0; 2*i < k; i++){
+            mac(t, c, a[i], a[k-i]);
+        }
+        for(uint64_t i = k+1; 2*i < k+r; i++){
+            mac(t, c, a[i], a[k+r-i]);
+        }
+        dbl(t, c);
+        uint64_t h = k & 1 ? (k+r)/2 : k/2;
+        mac(t, c, a[h], a[h]);
+        out[k] = m.reduce(c, t);
+    }
+}
+
+/**
+ * The 32-bit word versions of mac(), dbl(), mul_cyclic() and sqr_cyclic(),
+ * for montgomery32. A product of two words fits 64 bits, so the lazy sum is
+ * a 64-bit t with its carries in c, and c*2^64 + t < nR takes one redc().
+ */
+
+static inline void mac(uint64_t& t, uint64_t& c, uint32_t a, uint32_t b){
+    uint64_t ab = (uint64_t)a * b;
+    t += ab;
+    c += t < ab;
+}
+
+static inline void dbl(uint64_t& t, uint64_t& c){
+    c  = 2*c + (t >> 63);
+    t <<= 1;
+}
+
+template<uint64_t R>
+static void mul_cyclic(uint32_t* out, const uint32_t* a, const uint32_t* b,
+                       uint64_t r, const montgomery32& m){
+    if(R){r = R;}
+    for(uint64_t k = 0; k < r; k++){
+        uint64_t t = 0;
+        uint64_t c = 0;
+        for(uint64_t i = 0; i <= k; i++){
+            mac(t, c, a[i], b[k-i]);
+        }
+        for(uint64_t i = k+1; i < r; i++){
+            mac(t, c, a[i], b[k+r-i]);
+        }
+        out[k] = m.redc((unsigned __int128)c << 64 | t);
+    }
+}
+
+template<uint64_t R>
+static void sqr_cyclic(uint32_t* out, const uint32_t* a, uint64_t r,
+                       const montgomery32& m){
+    if(R){r = R;}
+    for(uint64_t k = 0; k < r; k++){
+        uint64_t t = 0;
+        uint64_t c = 0;
+        for(uint64_t i = 0; 2*i < k; i++){
+            mac(t, c, a[i], a[k-i]);
+        }
+        for(uint64_t i = k+1; 2*i < k+r; i++){
+            mac(t, c, a[i], a[k+r-i]);
+        }
+        dbl(t, c);
+        uint64_t h = k & 1 ? (k+r)/2 : k/2;
+        mac(t, c, a[h], a[h]);
+        out[k] = m.redc((unsigned __int128)c << 64 | t);
+    }
+}
+
+/**
+ * Linear (non-cyclic) product of two length-k coefficient arrays into
+ * out[0..2k-2], using Karatsuba's three-product split above
+ * KARATSUBA_THRESHOLD and the schoolbook product below it.
+ *
+ * The scratch area must hold at least 8*k words.
+ */
+
+static void mul_karatsuba(residue* out, const residue* a, const residue* b,
+                          uint64_t k, const montgomery& m, residue* scratch){
+    if(k < KARATSUBA_THRESHOLD){
+        for(uint64_t j = 0; j < 2*k-1; j++){
+            unsigned __int128 t = 0;
+            uint64_t          c = 0;
+            for(uint64_t i = j < k ? 0 : j-k+1; i <= j && i < k; i++){
+                mac(t, c, a[i], b[j-i]);
+            }
+            out[j] = m.reduce(c, t);
+        }
+        return;
+    }
+
+    /**
+     * a = a0 + x^h a1,  b = b0 + x^h b1,  with a0,b0 of length h and a1,b1 of
+     * length l <= h. Then
+     *
+     *     a*b = z0 + x^h ((a0+a1)(b0+b1) - z0 - z2) + x^2h z2
+     *
+     * where z0 = a0*b0 and z2 = a1*b1 land in disjoint parts of out[].
+     */
+
+    const uint64_t h = (k+1)/2;
+    const uint64_t l = k-h;
+    residue* sa = scratch;
+    residue* sb = sa + h;
+    residue* z1 = sb + h;
+    residue* next = z1 + 2*h;
+
+    mul_karatsuba(out,     a,   b,   h, m, next);
+    mul_karatsuba(out+2*h, a+h, b+h, l, m, next);
+    out[2*h-1] = residue();
+
+    for(uint64_t i = 0; i < h; i++){
+        sa[i] = i < l ? m.add(a[i], a[h+i]) : a[i];
+        sb[i] = i < l ? m.add(b[i], b[h+i]) : b[i];
+    }
+    mul_karatsuba(z1, sa, sb, h, m, next);
+
+    for(uint64_t i = 0; i < 2*h-1; i++){
+        z1[i] = m.sub(z1[i], out[i]);
+    }
+    for(uint64_t i = 0; i < 2*l-1; i++){
+        z1[i] = m.sub(z1[i], out[2*h+i]);
+    }
+    for(uint64_t i = 0; i < 2*h-1; i++){
+        out[h+i] = m.add(out[h+i], z1[i]);
+    }
+}
+
+/**
+ * Linear square of a length-k coefficient array into out[0..2k-2], the
+ * squaring counterpart of mul_karatsuba() with the same scratch needs.
+ */
+
+static void sqr_karatsuba(residue* out, const residue* a, uint64_t k,
+                          const montgomery& m, residue* scratch){
+    if(k < KARATSUBA_THRESHOLD){
+        for(uint64_t j = 0; j < 2*k-1; j++){
+            unsigned __int128 t = 0;
+            uint64_t          c = 0;
+            for(uint64_t i = j < k ? 0 : j-k+1; 2*i < j; i++){
+                mac(t, c, a[i], a[j-i]);
+            }
+            dbl(t, c);
+            if(~j & 1){
+                mac(t, c, a[j/2], a[j/2]);
+            }
+            out[j] = m.reduce(c, t);
+        }
+        return;
+    }
+
+    /* a^2 = z0 + x^h ((a0+a1)^2 - z0 - z2) + x^2h z2 */
+
+    const uint64_t h = (k+1)/2;
+    const uint64_t l = k-h;
+    residue* sa = scratch;
+    residue* z1 = sa + 2*h;
+    residue* next = z1 + 2*h;
+
+    sqr_karatsuba(out,     a,   h, m, next);
+    sqr_karatsuba(out+2*h, a+h, l, m, next);
+    out[2*h-1] = residue();
+
+    for(uint64_t i = 0; i < h; i++){
+        sa[i] = i < l ? m.add(a[i], a[h+i]) : a[i];
+    }
+    sqr_karatsuba(z1, sa, h, m, next);
+
+    for(uint64_t i = 0; i < 2*h-1; i++){
+        z1[i] = m.sub(z1[i], out[i]);
+    }
+    for(uint64_t i = 0; i < 2*l-1; i++){
+        z1[i] = m.sub(z1[i], out[2*h+i]);
+    }
+    for(uint64_t i = 0; i < 2*h-1; i++){
+        out[h+i] = m.add(out[h+i], z1[i]);
+    }
+}
+
+/**
+ * The ring operations on r coefficients at out, a and b, shared by
+ * polynomial and matrix. out must not overlap a or b, except in poly_add().
+ * The vector kernels and ntt_plan take the coefficients as data().
+ */
+
+template<uint64_t R>
+static void poly_add(residue* out, const residue* a, const residue* b,
+                     uint64_t r, const montgomery& m){
+    if(R){r = R;}
+    for (uint64_t i = 0; i < r; i++) {
+        out[i] = m.add(a[i], b[i]);
+    }
+}
+
+template<uint64_t R>
+static void poly_mul(residue* out, const residue* a, const residue* b,
+                     uint64_t r, const montgomery& m, const ntt_plan* ntt){
+    if(R){r = R;}
+
+    if(ntt){
+        buffer<0> A(ntt->words()), B(ntt->words());
+        ntt->forward(A.data(), data(a));
+        ntt->forward(B.data(), data(b));
+        ntt->mul(A.data(), A.data(), B.data());
+        ntt->inverse(data(out), A.data());
+        return;
+    }
+
+    if(r >= KARATSUBA_THRESHOLD){
+        // linear product, then fold x^(r+k) back onto x^k
+        buffer<2*R, residue> prod(2*r);
+        buffer<8*R, residue> scratch(8*r);
+        mul_karatsuba(prod.data(), a, b, r, m, scratch.data());
+        for (uint64_t i = 0; i < r; i++) {
+            out[i] = i+r < 2*r-1 ? m.add(prod.w[i], prod.w[i+r]) : prod.w[i];
+        }
+        return;
+    }
+
+    if(simd_mul_cyclic52 && m.n < SIMD_IFMA_MAX_N && r >= SIMD52_THRESHOLD && r <= SIMD_MAX_R){
+        simd_mul_cyclic52(data(out), data(a), data(b), r, m);
+        return;
+    }
+
+    mul_cyclic<R>(out, a, b, r, m);
+}
+
+// a*b + u*v, with the sum formed before the (single) reduction
+template<uint64_t R>
+static void poly_muladd(residue* out, const residue* a, const residue* b,
+                        const residue* u, const residue* v,
+                        uint64_t r, const montgomery& m, const ntt_plan* ntt){
+    if(R){r = R;}
+
+    if(ntt){
+        const uint64_t w = ntt->words();
+        buffer<0> T(4*w);
+        uint64_t *A = T.data(), *B = A+w, *U = B+w, *V = U+w;
+        ntt->forward(A, data(a));
+        ntt->forward(B, data(b));
+        ntt->forward(U, data(u));
+        ntt->forward(V, data(v));
+        ntt->mul   (A, A, B);
+        ntt->muladd(A, U, V);
+        ntt->inverse(data(out), A);
+        return;
+    }
+
+    if(r >= KARATSUBA_THRESHOLD){
+        // both linear products, then one pass to add and fold them
+        buffer<4*R, residue> prod(4*r);
+        buffer<8*R, residue> scratch(8*r);
+        residue* ab = prod.data();
+        residue* uv = ab + 2*r;
+        mul_karatsuba(ab, a, b, r, m, scratch.data());
+        mul_karatsuba(uv, u, v, r, m, scratch.data());
+        for (uint64_t i = 0; i < r; i++) {
+            residue y = m.add(ab[i], uv[i]);
+            out[i] = i+r < 2*r-1 ? m.add(y, m.add(ab[i+r], uv[i+r])) : y;
+        }
+        return;
+    }
+
+    muladd_cyclic<R>(out, a, b, u, v, r, m);
+}
+
+// a*a, computing each cross term a_i*a_j once
+template<uint64_t R>
+static void poly_sqr(residue* out, const residue* a,
+                     uint64_t r, const montgomery& m, const ntt_plan* ntt){
+    if(R){r = R;}
+
+    if(ntt){
+        buffer<0> A(ntt->words());
+        ntt->forward(A.data(), data(a));
+        ntt->mul(A.data(), A.data(), A.data());
+        ntt->inverse(data(out), A.data());
+        return;
+    }
+
+    if(r >= KARATSUBA_THRESHOLD){
+        buffer<2*R, residue> prod(2*r);
+        buffer<8*R, residue> scratch(8*r);
+        sqr_karatsuba(prod.data(), a, r, m, scratch.data());
+        for (uint64_t i = 0; i < r; i++) {
+            out[i] = i+r < 2*r-1 ? m.add(prod.w[i], prod.w[i+r]) : prod.w[i];
+        }
+        return;
+    }
+
+    if(simd_mul_cyclic52 && m.n < SIMD_IFMA_MAX_N && r >= SIMD52_THRESHOLD && r <= SIMD_MAX_R){
+        simd_mul_cyclic52(data(out), data(a), data(a), r, m);
+        return;
+    }
+
+    sqr_cyclic<R>(out, a, r, m);
+}
+
+/**
+ * The 32-bit ring operations. The r picked for n < 2^32 stays far below
+ * KARATSUBA_THRESHOLD, so these only have the schoolbook kernels.
+ */
+
+template<uint64_t R>
+static void poly_add(uint32_t* out, const uint32_t* a, const uint32_t* b,
+                     uint64_t r, const montgomery32& m){
+    if(R){r = R;}
+    for (uint64_t i = 0; i < r; i++) {
+        out[i] = m.add(a[i], b[i]);
+    }
+}
+
+template<uint64_t R>
+static void poly_mul(uint32_t* out, const uint32_t* a, const uint32_t* b,
+                     uint64_t r, const montgomery32& m, const ntt_plan*){
+    if(R){r = R;}
+    if(simd_mul_cyclic32 && r >= SIMD32_THRESHOLD && r <= SIMD_MAX_R){
+        simd_mul_cyclic32(out, a, b, r, m);
+        return;
+    }
+    mul_cyclic<R>(out, a, b, r, m);
+}
+
+template<uint64_t R>
+static void poly_sqr(uint32_t* out, const uint32_t* a,
+                     uint64_t r, const montgomery32& m, const ntt_plan*){
+    if(R){r = R;}
+    if(simd_mul_cyclic32 && r >= SIMD32_THRESHOLD && r <= SIMD_MAX_R){
+        simd_mul_cyclic32(out, a, a, r, m);
+        return;
+    }
+    sqr_cyclic<R>(out, a, r, m);
+}
+
+/**
+ * The multi-limb versions of mac(), dbl() and the ring operations, for
+ * montgomery_wide. A product of two L-limb words is 2L limbs, so the lazy
+ * sum is 2L limbs t with its carries in c, reduced by
+ * montgomery_wide::redc(c, t). The r picked for n past 64 bits stays small
+ * but for rare n, see chebyshev_select(), so these only have the schoolbook
+ * kernels.
+ */
+
+template<int L>
+static inline void mac(uint64_t* t, uint64_t& c, const wide<L>& a, const wide<L>& b){
+    for(int i = 0; i < L; i++){
+        uint64_t k = 0;
+        for(int j = 0; j < L; j++){
+            unsigned __int128 p = (unsigned __int128)a.limb[i] * b.limb[j] + t[i+j] + k;
+            t[i+j] = (uint64_t)p;
+            k      = (uint64_t)(p >> 64);
+        }
+        unsigned char carry = 0;
+        t[i+L] = limb_add(t[i+L], k, carry);
+        for(int j = i+L+1; j < 2*L; j++){
+            t[j] = limb_add(t[j], 0, carry);
+        }
+        c += carry;
+    }
+}
+
+template<int L>
+static inline void dbl(uint64_t* t, uint64_t& c){
+    c = 2*c + (t[2*L-1] >> 63);
+    for(int i = 2*L-1; i > 0; i--){
+        t[i] = t[i] << 1 | t[i-1] >> 63;
+    }
+    t[0] <<= 1;
+}
+
+template<uint64_t R, int L>
+static void mul_cyclic(wide<L>* out, const wide<L>* a, const wide<L>* b,
+                       uint64_t r, const montgomery_wide<L>& m){
+    if(R){r = R;}
+    for(uint64_t k = 0; k < r; k++){
+        uint64_t t[2*L] = {0};
+        uint64_t c      = 0;
+        for(uint64_t i = 0; i <= k; i++){
+            mac(t, c, a[i], b[k-i]);
+        }
+        for(uint64_t i = k+1; i < r; i++){
+            mac(t, c, a[i], b[k+r-i]);
+        }
+        out[k] = m.redc(c, t);
+    }
+}
+
+template<uint64_t R, int L>
+static void sqr_cyclic(wide<L>* out, const wide<L>* a, uint64_t r,
+                       const montgomery_wide<L>& m){
+    if(R){r = R;}
+    for(uint64_t k = 0; k < r; k++){
+        uint64_t t[2*L] = {0};
+        uint64_t c      = 0;
+        for(uint64_t i = 0; 2*i < k; i++){
+            mac(t, c, a[i], a[k-i]);
+        }
+        for(uint64_t i = k+1; 2*i < k+r; i++){
+            mac(t, c, a[i], a[k+r-i]);
+        }
+        dbl<L>(t, c);
+        uint64_t h = k & 1 ? (k+r)/2 : k/2;
+        mac(t, c, a[h], a[h]);
+        out[k] = m.redc(c, t);
+    }
+}
+
+template<uint64_t R, int L>
+static void poly_add(wide<L>* out, const wide<L>* a, const wide<L>* b,
+                     uint64_t r, const montgomery_wide<L>& m){
+    if(R){r = R;}
+    for (uint64_t i = 0; i < r; i++) {
+        out[i] = m.add(a[i], b[i]);
+    }
+}
+
+template<uint64_t R, int L>
+static void poly_mul(wide<L>* out, const wide<L>* a, const wide<L>* b,
+                     uint64_t r, const montgomery_wide<L>& m, const ntt_plan*){
+    mul_cyclic<R>(out, a, b, r, m);
+}
+
+template<uint64_t R, int L>
+static void poly_sqr(wide<L>* out, const wide<L>* a,
+                     uint64_t r, const montgomery_wide<L>& m, const ntt_plan*){
+    sqr_cyclic<R>(out, a, r, m);
+}
+
+// 0 as a coefficient; residue() is the only way to spell it for residue
+template<typename T> static inline T zero_word(){return T(0);}
+template<>           inline residue  zero_word(){return residue();}
+
+template<typename T>
+static inline void zero(std::vector <T, pooled<T> >& p, uint64_t r){p.assign(r, zero_word<T>());}
+template<typename T, size_t N>
+static inline void zero(std::array  <T, N>& p, uint64_t  ){p.fill(zero_word<T>());}
+
+/**
+ * An element of Z_n[x]/(x^r - 1). For R > 0 r is the compile-time constant
+ * R and the coefficients live inline in a std::array; R = 0 is the
+ * run-time sized version on a std::vector drawing on thread_workspace().
+ * Coefficients are words of the Montgomery arithmetic M: residue for
+ * montgomery, uint32_t for montgomery32 for n < 2^32, or wide<L> for
+ * montgomery_wide for n past 64 bits.
+ *
+ * The *_into() forms write their result to an existing polynomial of the
+ * same r, which must not be one of the operands (add_into() excepted). They
+ * are what the engines use; the operators wrap them for convenience.
+ */
+
+template<uint64_t R, typename M = montgomery>
+struct polynomial
+{
+    typedef typename M::word word;
+    typedef typename std::conditional<R != 0, std::array  <word, R>,
+                                              std::vector <word, pooled<word> > >::type coefficients;
+
+    polynomial(uint64_t r, const M* mont, const ntt_plan* ntt = NULL) :
+        mont(mont), ntt(ntt) {zero(p, r);}
+    const M*          mont;
+    coefficients      p;
+    const ntt_plan*   ntt;
+
+    // coefficients are kept in Montgomery form, see montgomery::to()
+
+    // implementation using Galois field
+    // Galoid field (x^r)^2x2
+    // Finite field arithmetic for lookup
+    void add_into(polynomial& ret, const polynomial& other) const {
+        poly_add<R>(&ret.p[0], &p[0], &other.p[0], p.size(), *mont);
+    }
+
+    // this is only there 
+    // because the finite field is the polynomial
+    // is mod x^r -1
+    void mul_into(polynomial& ret, const polynomial& other) const {
+        poly_mul<R>(&ret.p[0], &p[0], &other.p[0], p.size(), *mont, ntt);
+    }
+
+    void square_into(polynomial& ret) const {
+        poly_sqr<R>(&ret.p[0], &p[0], p.size(), *mont, ntt);
+    }
+
+    polynomial operator+ (const polynomial& other) const {
+        polynomial ret(p.size(), mont, ntt);
+        add_into(ret, other);
+        return ret;
+    }
+
+    polynomial operator* (const polynomial& other) const {
+        polynomial ret(p.size(), mont, ntt);
+        mul_into(ret, other);
+        return ret;
+    }
+
+    polynomial square() const {
+        polynomial ret(p.size(), mont, ntt);
+        square_into(ret);
+        return ret;
+    }
+};
+
+
+/**
+ * A 2x2 matrix over Z_n[x]/(x^r - 1). Its entries sit back to back, p00 p01
+ * p10 p11, in one 64-byte aligned block of 4r coefficients (inline for
+ * R > 0), so an operand is a single stream through memory instead of four.
+ *
+ * Given an ntt_plan, polynomial and matrix multiply through its transforms,
+ * which BM_matrix_mul puts ahead of Karatsuba only from r of a few
+ * thousand; the engines, whose r stays at or below CHEBYSHEV_MAX_R for
+ * n < 2^64, build them without one.
+ */
+
+template<uint64_t R>
+struct matrix
+{
+    typedef typename std::conditional<R != 0, std::array  <residue, 4*R>,
+                                              std::vector <residue, pooled<residue> > >::type coefficients;
+
+    matrix(uint64_t r, const montgomery* mont, const ntt_plan* ntt = NULL) :
+        mont(mont), ntt(ntt), r(r) {zero(c, 4*r);}
+    
+    const montgomery* mont;
+    const ntt_plan* ntt;
+    uint64_t        r;
+    alignas(64) coefficients c;
+
+    residue*        p00()       {return &c[0];}
+    residue*        p01()       {return &c[  (R ? R : r)];}
+    residue*        p10()       {return &c[2*(R ? R : r)];}
+    residue*        p11()       {return &c[3*(R ? R : r)];}
+    const residue*  p00() const {return &c[0];}
+    const residue*  p01() const {return &c[  (R ? R : r)];}
+    const residue*  p10() const {return &c[2*(R ? R : r)];}
+    const residue*  p11() const {return &c[3*(R ? R : r)];}
+
+    // | p00 p01 | * | q00 q01 | = | p00*q00+p01*q10 p00*q01+p01q11 |
+    // | p10 p11 |   | q10 q11 |   | p10*q00+p11*q10 p10*q01+p11q11 |
+
+    // operator for fast exponentiation; ret must not be an operand
+    void mul_into(matrix& ret, const matrix& other) const {
+        const montgomery& m = *mont;
+
+        if(ntt){
+            // transform each distinct entry once; a square shares all four
+            const uint64_t w = ntt->words();
+            const bool     sq = this == &other;
+            buffer<0> T((sq ? 5 : 9)*w);
+            uint64_t *P00 = T.data(), *P01 = P00+w, *P10 = P01+w, *P11 = P10+w;
+            uint64_t *Q00 = P00,      *Q01 = P01,   *Q10 = P10,   *Q11 = P11;
+            uint64_t *acc = P11+w;
+            if(!sq){
+                Q00 = acc; Q01 = Q00+w; Q10 = Q01+w; Q11 = Q10+w; acc = Q11+w;
+            }
+
+            ntt->forward(P00, data(this->p00()));
+            ntt->forward(P01, data(this->p01()));
+            ntt->forward(P10, data(this->p10()));
+            ntt->forward(P11, data(this->p11()));
+            if(!sq){
+                ntt->forward(Q00, data(other.p00()));
+                ntt->forward(Q01, data(other.p01()));
+                ntt->forward(Q10, data(other.p10()));
+                ntt->forward(Q11, data(other.p11()));
+            }
+
+            ntt->mul(acc, P00, Q00); ntt->muladd(acc, P01, Q10); ntt->inverse(data(ret.p00()), acc);
+            ntt->mul(acc, P00, Q01); ntt->muladd(acc, P01, Q11); ntt->inverse(data(ret.p01()), acc);
+            ntt->mul(acc, P10, Q00); ntt->muladd(acc, P11, Q10); ntt->inverse(data(ret.p10()), acc);
+            ntt->mul(acc, P10, Q01); ntt->muladd(acc, P11, Q11); ntt->inverse(data(ret.p11()), acc);
+            return;
+        }
+
+        poly_muladd<R>(ret.p00(), p00(), other.p00(), p01(), other.p10(), r, m, ntt);
+        poly_muladd<R>(ret.p01(), p00(), other.p01(), p01(), other.p11(), r, m, ntt);
+        poly_muladd<R>(ret.p10(), p10(), other.p00(), p11(), other.p10(), r, m, ntt);
+        poly_muladd<R>(ret.p11(), p10(), other.p01(), p11(), other.p11(), r, m, ntt);
+    }
+
+    // | p00 p01 |^2 = | p00^2+p01*p10  p01*(p00+p11) |
+    // | p10 p11 |     | p10*(p00+p11)  p11^2+p01*p10 |
+
+    // 5 polynomial products instead of 8, two of them squares
+    void square_into(matrix& ret) const {
+        const montgomery& m = *mont;
+
+        if(ntt){
+            // the transforms are shared already, see mul_into()
+            mul_into(ret, *this);
+            return;
+        }
+
+        buffer<R, residue> bc(r), trace(r);
+        poly_mul<R>(bc.data(),    p01(), p10(), r, m, ntt);
+        poly_add<R>(trace.data(), p00(), p11(), r, m);
+        poly_sqr<R>(ret.p00(), p00(), r, m, ntt); poly_add<R>(ret.p00(), ret.p00(), bc.data(), r, m);
+        poly_mul<R>(ret.p01(), p01(), trace.data(), r, m, ntt);
+        poly_mul<R>(ret.p10(), p10(), trace.data(), r, m, ntt);
+        poly_sqr<R>(ret.p11(), p11(), r, m, ntt); poly_add<R>(ret.p11(), ret.p11(), bc.data(), r, m);
+    }
+
+    // | p00 p01 | * | 2x -1 | = | 2x*p00+p01  -p00 |
+    // | p10 p11 |   |  1  0 |   | 2x*p10+p11  -p10 |
+
+    // product with the companion matrix in O(r); x* is a cyclic shift
+    void mul_base_into(matrix& ret) const {
+        const uint64_t  r  = R ? R : this->r;
+        const residue  *a  = p00(), *b = p01(), *c = p10(), *d = p11();
+        residue        *a2 = ret.p00(), *b2 = ret.p01(), *c2 = ret.p10(), *d2 = ret.p11();
+
+        for (uint64_t k = 0; k < r; k++) {
+            uint64_t j = k ? k-1 : r-1;
+            a2[k] = mont->add(mont->dbl(a[j]), b[k]);
+            b2[k] = mont->sub(residue(), a[k]);
+            c2[k] = mont->add(mont->dbl(c[j]), d[k]);
+            d2[k] = mont->sub(residue(), c[k]);
+        }
+    }
+
+    // value-returning forms; the engines use the *_into() ones instead,
+    // which write to a matrix the caller keeps, so no in-place *= is kept
+    matrix operator* (const matrix& other) const {
+        matrix ret(r, mont, ntt);
+        mul_into(ret, other);
+        return ret;
+    }
+
+    matrix square() const {
+        matrix ret(r, mont, ntt);
+        square_into(ret);
+        return ret;
+    }
+
+    matrix mul_base() const {
+        matrix ret(r, mont, ntt);
+        mul_base_into(ret);
+        return ret;
+    }
+
+};
+
+
+/* End Include Guards */
+#endif
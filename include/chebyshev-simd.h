@@ -0,0 +1,110 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_SIMD_H
+#define CHEBYSHEV_SIMD_H
+
+
+/* Includes */
+#include <stdint.h>
+#include "chebyshev-montgomery.h"
+
+
+/* Defines */
+
+/**
+ * Largest r the vector kernels take. Their callers only use them below
+ * the Karatsuba threshold, and the kernels keep an extended copy of b on
+ * the stack.
+ */
+
+#define SIMD_MAX_R 64
+
+/**
+ * The 52-bit kernels need coefficients, i.e. n, below 2^52; the margin
+ * keeps r*n below 2^64 too, so a whole sum takes one redc().
+ */
+
+#define SIMD_IFMA_MAX_N (1ULL << 50)
+
+/**
+ * Largest r the lockstep ladder takes: its reductions bring a sum of r
+ * products below n in five conditional subtractions.
+ */
+
+#define SIMD_LADDER_MAX_R 31
+
+/**
+ * Moduli, i.e. lanes, per call of the lockstep ladder.
+ */
+
+#define SIMD_LADDER_LANES 8
+
+
+/**
+ * @brief Vector kernels for the cyclic product
+ *
+ *     $$out[k] = \sum_i a[i] b[(k-i) \bmod r] \pmod n$$
+ *
+ * of Montgomery-form coefficients, r <= SIMD_MAX_R, computing several
+ * consecutive out[k] per instruction against an extended copy of b.
+ *
+ * Each pointer is NULL when the CPU lacks the instructions; that is
+ * decided once, from CPUID, at startup. The scalar mul_cyclic() is the
+ * fallback and the reference they are checked against.
+ */
+
+/**
+ * 32-bit words (see montgomery32), four 32x32->64-bit products per AVX2
+ * instruction.
+ */
+
+typedef void (*simd_mul_cyclic32_fn)(uint32_t* out, const uint32_t* a, const uint32_t* b,
+                                     uint64_t r, const montgomery& m);
+
+/**
+ * 64-bit words holding residues below SIMD_IFMA_MAX_N, eight 52-bit
+ * multiply-adds per AVX-512 IFMA instruction or, without IFMA, products
+ * in double precision split exactly by FMA, eight per AVX-512F or four per
+ * AVX2 instruction.
+ */
+
+typedef void (*simd_mul_cyclic52_fn)(uint64_t* out, const uint64_t* a, const uint64_t* b,
+                                     uint64_t r, const montgomery& m);
+
+/**
+ * @brief Lockstep Chebyshev ladder over SIMD_LADDER_LANES moduli.
+ *
+ * Runs the doubling ladder of chebyshev_ladder() for odd n[l] < SIMD_IFMA_MAX_N,
+ * one per lane, all with the same r <= SIMD_LADDER_MAX_R with r < n[l], and
+ * returns a mask with bit l set when
+ *
+ *     $$T_{n[l]}(x) = x^{n[l]} \pmod{x^r - 1, n[l]}$$
+ *
+ * Shorter n just run through leading zero bits, which leave the starting
+ * pair (T_0, T_1) unchanged, so every lane follows the same control flow.
+ */
+
+typedef unsigned (*simd_chebyshev52_fn)(const uint64_t* n, uint64_t r);
+
+extern const simd_mul_cyclic32_fn simd_mul_cyclic32;
+extern const simd_mul_cyclic52_fn simd_mul_cyclic52;
+extern const simd_chebyshev52_fn  simd_chebyshev52;
+
+/**
+ * The FMA kernel on its own, which is what simd_mul_cyclic52 holds on
+ * hosts without IFMA, so that both can be benchmarked on one that has it.
+ */
+
+extern const simd_mul_cyclic52_fn simd_mul_cyclic52_fma;
+
+/**
+ * @brief Name the kernel each pointer holds, "scalar" when it is NULL, for
+ * reports of what a given host runs.
+ */
+
+const char* simd_mul_cyclic32_kernel();
+const char* simd_mul_cyclic52_kernel();
+const char* simd_chebyshev52_kernel();
+
+
+/* End Include Guards */
+#endif
@@ -0,0 +1,181 @@
+/* Include Guards */
+#ifndef CHEBYSHEV_WIDE_H
+#define CHEBYSHEV_WIDE_H
+
+
+/* Includes */
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+
+/**
+ * @brief An unsigned integer of L 64-bit limbs, least significant first.
+ *
+ * Just enough of an integer type for isprime_chebyshev() and gaIIsPrime()
+ * on n past 64 bits: limbs live inline, every loop runs over the
+ * compile-time L, and the carry chains go through add-with-carry, so a
+ * wide<2> or wide<4> costs no allocation and unrolls completely.
+ */
+
+template<int L> struct wide
+{
+    wide() {}
+    wide(uint64_t x) {
+        limb[0] = x;
+        for(int i = 1; i < L; i++){
+            limb[i] = 0;
+        }
+    }
+
+    /**
+     * @brief Whether the value fits limb[0] alone.
+     */
+
+    bool narrow() const{
+        uint64_t high = 0;
+        for(int i = 1; i < L; i++){
+            high |= limb[i];
+        }
+        return high == 0;
+    }
+
+    /**
+     * @brief Number of significant bits, 0 for 0.
+     */
+
+    int bits() const{
+        for(int i = L-1; i >= 0; i--){
+            if(limb[i]){
+                return 64*i + 64-__builtin_clzll(limb[i]);
+            }
+        }
+        return 0;
+    }
+
+    bool bit(int i) const{return (limb[i/64] >> (i%64)) & 1;}
+
+    /**
+     * @brief Trailing zero bits of a nonzero value.
+     */
+
+    int ctz() const{
+        int i = 0;
+        while(!limb[i]){
+            i++;
+        }
+        return 64*i + __builtin_ctzll(limb[i]);
+    }
+
+    /**
+     * @brief The value mod a small s, limb by limb from the top.
+     */
+
+    uint64_t mod(uint64_t s) const{
+        uint64_t x = 0;
+        for(int i = L-1; i >= 0; i--){
+            x = (((unsigned __int128)x << 64) | limb[i]) % s;
+        }
+        return x;
+    }
+
+    uint64_t limb[L];
+};
+
+typedef wide<2> wide128;
+typedef wide<4> wide256;
+
+template<int L>
+static inline bool operator==(const wide<L>& a, const wide<L>& b){
+    uint64_t diff = 0;
+    for(int i = 0; i < L; i++){
+        diff |= a.limb[i] ^ b.limb[i];
+    }
+    return diff == 0;
+}
+
+template<int L>
+static inline bool operator!=(const wide<L>& a, const wide<L>& b){return !(a == b);}
+
+/**
+ * The limb primitives: the sum and difference of single limbs with a carry
+ * or borrow in and out, which on x86_64 are one adc or sbb each.
+ */
+
+static inline uint64_t limb_add(uint64_t a, uint64_t b, unsigned char& carry){
+#if defined(__x86_64__)
+    unsigned long long s;
+    carry = _addcarry_u64(carry, a, b, &s);
+    return s;
+#else
+    unsigned __int128 s = (unsigned __int128)a + b + carry;
+    carry = (unsigned char)(s >> 64);
+    return (uint64_t)s;
+#endif
+}
+
+static inline uint64_t limb_sub(uint64_t a, uint64_t b, unsigned char& borrow){
+#if defined(__x86_64__)
+    unsigned long long d;
+    borrow = _subborrow_u64(borrow, a, b, &d);
+    return d;
+#else
+    unsigned __int128 d = (unsigned __int128)a - b - borrow;
+    borrow = (unsigned char)(d >> 64) & 1;
+    return (uint64_t)d;
+#endif
+}
+
+/**
+ * @brief out = a + b mod 2^64L, returning the carry out.
+ */
+
+template<int L>
+static inline unsigned char wide_add(wide<L>& out, const wide<L>& a, const wide<L>& b){
+    unsigned char carry = 0;
+    for(int i = 0; i < L; i++){
+        out.limb[i] = limb_add(a.limb[i], b.limb[i], carry);
+    }
+    return carry;
+}
+
+/**
+ * @brief out = a - b mod 2^64L, returning the borrow out, i.e. a < b.
+ */
+
+template<int L>
+static inline unsigned char wide_sub(wide<L>& out, const wide<L>& a, const wide<L>& b){
+    unsigned char borrow = 0;
+    for(int i = 0; i < L; i++){
+        out.limb[i] = limb_sub(a.limb[i], b.limb[i], borrow);
+    }
+    return borrow;
+}
+
+template<int L>
+static inline bool operator<(const wide<L>& a, const wide<L>& b){
+    wide<L> d;
+    return wide_sub(d, a, b);
+}
+
+/**
+ * @brief a >> k, for k < 64L.
+ */
+
+template<int L>
+static inline wide<L> wide_shr(const wide<L>& a, int k){
+    const int q = k/64, b = k%64;
+    wide<L>   out(0);
+    for(int i = 0; i+q < L; i++){
+        out.limb[i] = a.limb[i+q] >> b;
+        if(b && i+q+1 < L){
+            out.limb[i] |= a.limb[i+q+1] << (64-b);
+        }
+    }
+    return out;
+}
+
+
+/* End Include Guards */
+#endif
@@ -18,6 +18,38 @@
 extern "C" {
 #endif
 
+/* Data Structures */
+
+/**
+ * @brief A modulus n, with what its arithmetic needs precomputed.
+ *
+ * Built once per n by gaIModCtxInit(), it lets the *Ctx functions below
+ * work without a hardware divide. The Montgomery members, with R = 2^64,
+ * are meaningful for odd n only.
+ */
+
+typedef struct gaIModCtx{
+	uint64_t n;
+	uint64_t ninv;      /* n^-1 mod R */
+	uint64_t one;       /* R    mod n */
+	uint64_t r2;        /* R^2  mod n */
+	uint64_t v;         /* Reciprocal of n << shift, see gaIModCtxInit() */
+	int      shift;     /* Leading zeros of n */
+} gaIModCtx;
+
+/**
+ * @brief A fixed factor w < n, with its Shoup quotient floor(w 2^64 / n).
+ *
+ * Multiplying many values by the same w through gaIMulShoupCtx() costs a
+ * high and two low multiplications and one conditional subtraction each.
+ */
+
+typedef struct gaIShoup{
+	uint64_t w;
+	uint64_t q;
+} gaIShoup;
+
+
 /* Functions */
 
 /**
@@ -120,6 +152,68 @@ uint64_t gaIMulMod    (uint64_t a, uint64_t b, uint64_t m);
 
 uint64_t gaIPowMod    (uint64_t x, uint64_t a, uint64_t m);
 
+/**
+ * @brief Builds the modulus context of n.
+ *
+ * Costs one 128-by-64-bit divide, for the Möller-Granlund reciprocal
+ *
+ *     $$v = \lfloor (2^{128}-1)/(n 2^{shift}) \rfloor - 2^{64}$$
+ *
+ * that gaIModCtxReduce() and gaIMulModCtx() reduce with.
+ *
+ * @param [out] ctx  The context.
+ * @param [in]  n    The modulus, > 0.
+ */
+
+void     gaIModCtxInit(gaIModCtx* ctx, uint64_t n);
+
+/**
+ * @brief Computes a mod n for any 64-bit a.
+ */
+
+uint64_t gaIModCtxReduce(const gaIModCtx* ctx, uint64_t a);
+
+/**
+ * @brief gaIAddMod(), gaISubMod() and gaIAvgMod() on a context.
+ *
+ * The operands must already be reduced mod n; gaIAvgModCtx() needs n odd.
+ * They work on plain and Montgomery forms alike.
+ */
+
+uint64_t gaIAddModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b);
+uint64_t gaISubModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b);
+uint64_t gaIAvgModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b);
+
+/**
+ * @brief gaIMulMod() on a context, for a < n and any b.
+ */
+
+uint64_t gaIMulModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b);
+
+/**
+ * @brief Precomputes the Shoup multiplier of w < n.
+ */
+
+void     gaIShoupInit (gaIShoup* s, const gaIModCtx* ctx, uint64_t w);
+
+/**
+ * @brief Computes a*w mod n for the w of s and any a, if n < 2^63.
+ *
+ * The product keeps the form of a, so a plain w takes a Montgomery-form a
+ * to the Montgomery form of a*w.
+ */
+
+uint64_t gaIMulShoupCtx(const gaIModCtx* ctx, uint64_t a, const gaIShoup* s);
+
+/**
+ * @brief gaIPowMod() on a context.
+ *
+ * Odd moduli are worked in Montgomery form, even ones through
+ * gaIMulModCtx().
+ */
+
+uint64_t gaIPowModCtx (const gaIModCtx* ctx, uint64_t x, uint64_t a);
+
 /**
  * @brief Jacobi Symbol
  *
@@ -143,6 +237,22 @@ int      gaIJacobiSymbol(uint64_t a, uint64_t n);
 
 int      gaIIsPrimeStrongFermat(uint64_t n, uint64_t a);
 
+/**
+ * @brief gaIIsPrimeStrongFermat() for the modulus of a context.
+ */
+
+int      gaIIsPrimeStrongFermatCtx(const gaIModCtx* ctx, uint64_t a);
+
+/**
+ * @brief Names the implementation of gaIIsPrimeStrongFermat() in use.
+ *
+ * On x86_64 with GCC it is picked for the host when the program is loaded.
+ *
+ * @return "montgomery-bmi2" or "montgomery".
+ */
+
+const char* gaIIsPrimeStrongFermatKernel(void);
+
 /**
  * @brief Strong Lucas probable prime test.
  *
@@ -151,6 +261,15 @@ int      gaIIsPrimeStrongFermat(uint64_t n, uint64_t a);
  * @param [in] n  An odd integer >= 3.
  * @return Non-zero if n is a strong probable prime and zero if n is composite.
  */
+
+int      gaIIsPrimeStrongLucas(uint64_t n);
+
+/**
+ * @brief gaIIsPrimeStrongLucas() for the modulus of a context.
+ */
+
+int      gaIIsPrimeStrongLucasCtx(const gaIModCtx* ctx);
+
 /* End C++ Extern "C" Guard */
 #ifdef __cplusplus
 }
@@ -0,0 +1,457 @@
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "../include/benchmark.h"
+#include "../include/chebyshev-big.h"
+#include "../include/chebyshev-oracle.h"
+#include "../include/chebyshev-pool.h"
+#include "../include/chebyshev-primality-test.h"
+#include "../include/chebyshev-ring.h"
+
+/**
+ * Heap allocations made by the current thread, counted by the replacement
+ * operator new below so that BM_chebyshev can check that a test allocates
+ * nothing once thread_workspace() has warmed up. The array and sized forms
+ * are replaced too, so that every allocation is counted and every block
+ * goes back to free(). They all stay out of line: inlined, GCC would see
+ * free() or operator delete take what malloc() or operator new returned,
+ * and warn of a mismatch.
+ */
+
+static thread_local uint64_t allocations = 0;
+
+__attribute__((noinline))
+void* operator new(size_t bytes)
+{
+    allocations++;
+    if(void* block = malloc(bytes ? bytes : 1)){
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline))
+void* operator new[](size_t bytes)
+{
+    return operator new(bytes);
+}
+
+__attribute__((noinline))
+void operator delete(void* block) noexcept
+{
+    free(block);
+}
+
+__attribute__((noinline))
+void operator delete[](void* block) noexcept
+{
+    free(block);
+}
+
+__attribute__((noinline))
+void operator delete(void* block, size_t) noexcept
+{
+    free(block);
+}
+
+__attribute__((noinline))
+void operator delete[](void* block, size_t) noexcept
+{
+    free(block);
+}
+
+/**
+ * Whether n <= MAX_INT_CHEBYSHEV is prime, sieved once for all of them
+ * rather than run through gaIIsPrime() on every iteration.
+ */
+
+static bool oracle_is_prime(uint64_t n) {
+  static const uint64_t             max = std::stol(std::getenv("MAX_INT_CHEBYSHEV"));
+  static const std::vector<uint8_t> prime = [] {
+    std::vector<uint8_t> p(max+1);
+    prime_oracle(max+1).range(0, max+1, p.data());
+    return p;
+  }();
+  return n <= max ? prime[n] : gaIIsPrime(n) != 0;
+}
+
+static void BM_chebyshev(benchmark::State& state, chebyshev_engine engine) {
+
+  // warm up thread_workspace() for this n's r
+  isprime_chebyshev(state.range(0), engine);
+
+  for (auto _ : state) {
+    uint64_t before = allocations;
+    bool prime = isprime_chebyshev(state.range(0), engine);
+    bool allocated = allocations != before;
+    bool sanity_test = oracle_is_prime(state.range(0));
+    state.counters["IS PRIME"] = prime; 
+    if (sanity_test != prime) {
+        std::cout << "Sanity check failed for " << state.range(0) << "\n";
+        break;
+    }
+    if (allocated) {
+        std::cout << "Allocation check failed for " << state.range(0) << "\n";
+        break;
+    }
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+// both engines are checked against the oracle, and so against each other
+BENCHMARK_CAPTURE(BM_chebyshev, ladder, CHEBYSHEV_LADDER)->DenseRange(1, std::stol(std::getenv("MAX_INT_CHEBYSHEV") ) )->Complexity();
+BENCHMARK_CAPTURE(BM_chebyshev, matrix, CHEBYSHEV_MATRIX)->DenseRange(1, std::stol(std::getenv("MAX_INT_CHEBYSHEV") ) )->Complexity();
+BENCHMARK_CAPTURE(BM_chebyshev, matrix_sparse, CHEBYSHEV_MATRIX_SPARSE)->DenseRange(1, std::stol(std::getenv("MAX_INT_CHEBYSHEV") ) )->Complexity();
+
+/**
+ * The 4096 odd numbers from 2^k + 1, k the argument, through
+ * isprime_chebyshev_batch() or one by one, for numbers per second of each.
+ */
+
+static void BM_chebyshev_range(benchmark::State& state, bool batch) {
+  std::vector<uint64_t> n(4096);
+  std::vector<uint8_t>  prime(n.size());
+  for (size_t i = 0; i < n.size(); i++) {
+    n[i] = (1ULL << state.range(0)) + 2*i + 1;
+  }
+
+  for (auto _ : state) {
+    if (batch) {
+      isprime_chebyshev_batch(n.data(), n.size(), prime.data());
+    } else {
+      for (size_t i = 0; i < n.size(); i++) {
+        prime[i] = isprime_chebyshev(n[i]);
+      }
+    }
+  }
+  std::vector<uint8_t> truth(2*n.size());
+  prime_oracle(n.back()+1).range(n[0], n.back()+1, truth.data());
+  for (size_t i = 0; i < n.size(); i++) {
+    if (prime[i] != truth[2*i]) {
+        std::cout << "Sanity check failed for " << n[i] << "\n";
+        break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n.size());
+}
+
+BENCHMARK_CAPTURE(BM_chebyshev_range, each,  false)->Arg(32)->Arg(48)->Arg(62);
+BENCHMARK_CAPTURE(BM_chebyshev_range, batch, true )->Arg(32)->Arg(48)->Arg(62);
+
+/**
+ * The 256 odd numbers from 2^k + 1, k the argument, as wide<L>, for
+ * numbers per second past 64 bits; checked against gaIIsPrime() on wide<L>.
+ */
+
+template<int L>
+static void BM_chebyshev_wide(benchmark::State& state) {
+  std::vector<wide<L> > n(256, wide<L>(0));
+  std::vector<uint8_t>  prime(n.size());
+  for (size_t i = 0; i < n.size(); i++) {
+    n[i].limb[state.range(0)/64] |= 1ULL << (state.range(0)%64);
+    n[i].limb[0]                 |= 2*i + 1;
+  }
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < n.size(); i++) {
+      prime[i] = isprime_chebyshev(n[i]);
+    }
+  }
+  for (size_t i = 0; i < n.size(); i++) {
+    if (prime[i] != gaIIsPrime(n[i])) {
+        std::cout << "Sanity check failed for 2^" << state.range(0) << " + " << 2*i+1 << "\n";
+        break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n.size());
+}
+
+BENCHMARK_TEMPLATE(BM_chebyshev_wide, 2)->Arg(64)->Arg(96)->Arg(127);
+BENCHMARK_TEMPLATE(BM_chebyshev_wide, 4)->Arg(128)->Arg(192)->Arg(255);
+
+/**
+ * The Mersenne number 2^p - 1 of the first argument, past 256 bits, through
+ * isprime_chebyshev_big() with a pool of the second argument's threads.
+ * 521 and 1279 give Mersenne primes, 523 and 1277 composites.
+ */
+
+static void BM_chebyshev_big(benchmark::State& state, chebyshev_engine engine) {
+  const int             p = state.range(0);
+  std::vector<uint64_t> n((p+63)/64, ~0ULL);
+  n.back() >>= 64*n.size() - p;
+  chebyshev_pool pool(state.range(1));
+
+  bool prime = false;
+  for (auto _ : state) {
+    prime = isprime_chebyshev_big(n.data(), n.size(), engine, &pool);
+  }
+  if (prime != (p == 521 || p == 1279)) {
+      std::cout << "Sanity check failed for 2^" << p << " - 1\n";
+  }
+}
+
+BENCHMARK_CAPTURE(BM_chebyshev_big, ladder, CHEBYSHEV_LADDER)
+    ->ArgsProduct({{521, 523, 1277, 1279}, {1, 2}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_chebyshev_big, matrix, CHEBYSHEV_MATRIX)
+    ->ArgsProduct({{521, 523}, {1, 2}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/**
+ * One dense matrix multiply on its own, to watch the memory behaviour of the
+ * matrix layout as r grows; run under perf stat -e L1-dcache-load-misses,
+ * LLC-load-misses for the miss counts. R = 0 takes r from the first
+ * argument, and multiplies through an ntt_plan when the second is 1, or
+ * through Karatsuba when it is 0, for where the NTT starts to pay off; the
+ * NTT product is checked against the Karatsuba one.
+ */
+
+template<uint64_t R>
+static void BM_matrix_mul(benchmark::State& state) {
+  const uint64_t  r = R ? R : state.range(0);
+  montgomery      mont(18446744073709551557ULL);// largest 64-bit prime
+  const ntt_plan* ntt = !R && state.range(1) ? thread_workspace().plan(r, mont) : NULL;
+  matrix<R> a(r, &mont, ntt), b(r, &mont, ntt), c(r, &mont, ntt);
+  for (uint64_t k = 0; k < 4*r; k++) {
+    a.c[k] = mont.lift(k+1);
+    b.c[k] = mont.lift(3*k+2);
+  }
+
+  for (auto _ : state) {
+    a.mul_into(c, b);
+    benchmark::DoNotOptimize(c.c[0]);
+  }
+  if (ntt) {
+    matrix<R> plain(a), expected(r, &mont);
+    plain.ntt = NULL;
+    plain.mul_into(expected, b);
+    if (c.c != expected.c) {
+        std::cout << "Sanity check failed for the NTT product at r = " << r << "\n";
+    }
+  }
+  state.SetComplexityN(r);
+}
+
+BENCHMARK_TEMPLATE(BM_matrix_mul,   5);
+BENCHMARK_TEMPLATE(BM_matrix_mul,  11);
+BENCHMARK_TEMPLATE(BM_matrix_mul,  61);
+BENCHMARK_TEMPLATE(BM_matrix_mul, 173);
+BENCHMARK_TEMPLATE(BM_matrix_mul,   0)->ArgsProduct({{389, 1031, 4099}, {0, 1}});
+
+/**
+ * A cyclic product through an ntt_plan at r the argument, checked, with the
+ * square and the fused a*b + u*v, against mul_cyclic().
+ */
+
+static void BM_poly_mul_ntt(benchmark::State& state) {
+  const uint64_t        r = state.range(0);
+  montgomery            mont(18446744073709551557ULL);
+  const ntt_plan*       ntt = thread_workspace().plan(r, mont);
+  std::vector<residue>  a(r), b(r), u(r), v(r), c(r), expected(r), uv(r);
+  for (uint64_t k = 0; k < r; k++) {
+    a[k] = mont.lift(k+1);
+    b[k] = mont.lift(3*k+2);
+    u[k] = mont.lift(5*k+3);
+    v[k] = mont.lift(7*k+4);
+  }
+
+  for (auto _ : state) {
+    poly_mul<0>(c.data(), a.data(), b.data(), r, mont, ntt);
+    benchmark::DoNotOptimize(c[0]);
+  }
+  mul_cyclic<0>(expected.data(), a.data(), b.data(), r, mont);
+  bool same = c == expected;
+  poly_sqr<0>(c.data(), a.data(), r, mont, ntt);
+  mul_cyclic<0>(expected.data(), a.data(), a.data(), r, mont);
+  same = same && c == expected;
+  poly_muladd<0>(c.data(), a.data(), b.data(), u.data(), v.data(), r, mont, ntt);
+  mul_cyclic<0>(expected.data(), a.data(), b.data(), r, mont);
+  mul_cyclic<0>(uv.data(), u.data(), v.data(), r, mont);
+  poly_add<0>(expected.data(), expected.data(), uv.data(), r, mont);
+  same = same && c == expected;
+  if (!same) {
+      std::cout << "Sanity check failed for the NTT product at r = " << r << "\n";
+  }
+  state.SetComplexityN(r);
+}
+
+BENCHMARK(BM_poly_mul_ntt)->Arg(389)->Arg(1031)->Arg(4099);
+
+/**
+ * The integer product of isprime_chebyshev_big() on m limbs, the first
+ * argument, through big_mul() (1) or big_mul_ntt() (0), either side of
+ * BIG_NTT_THRESHOLD; the two are checked against each other.
+ */
+
+static void BM_big_mul(benchmark::State& state) {
+  const size_t          m = state.range(0);
+  std::vector<uint64_t> a(m), b(m), c(2*m), expected(2*m), scratch(big_mul_scratch(m)+1);
+  for (size_t i = 0; i < m; i++) {
+    a[i] = 0x9E3779B97F4A7C15ULL * (2*i+1);
+    b[i] = i % 7 ? 0xC2B2AE3D27D4EB4FULL * (2*i+1) : ~0ULL;
+  }
+
+  for (auto _ : state) {
+    if (state.range(1)) {
+      big_mul(c.data(), a.data(), b.data(), m, scratch.data());
+    } else {
+      big_mul_ntt(c.data(), a.data(), b.data(), m);
+    }
+    benchmark::DoNotOptimize(c[0]);
+  }
+  if (state.range(1)) {
+    big_mul_ntt(expected.data(), a.data(), b.data(), m);
+  } else {
+    big_mul(expected.data(), a.data(), b.data(), m, scratch.data());
+  }
+  if (c != expected) {
+      std::cout << "Sanity check failed for the " << m << "-limb product\n";
+  }
+  state.SetComplexityN(m);
+}
+
+BENCHMARK(BM_big_mul)->ArgsProduct({{1024, 4096, 7168, 16384}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
+/**
+ * Modular products per second modulo an odd n of k bits, k the argument:
+ * one at a time through the mul/div of gaIMulMod(), or r^2 at a time in a
+ * cyclic product through the scalar kernel, simd_mul_cyclic52 (IFMA where
+ * the host has it) or the double-precision FMA kernel.
+ */
+
+static uint64_t odd_modulus(int bits) {
+  return (1ULL << (bits-1)) | (0x5DEECE66DULL & ((1ULL << (bits-1)) - 1)) | 1;
+}
+
+static void BM_mulmod(benchmark::State& state) {
+  const uint64_t        n = odd_modulus(state.range(0));
+  std::vector<uint64_t> a(4096), b(a.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i] = (0x9E3779B97F4A7C15ULL * (2*i+1)) % n;
+    b[i] = (0xC2B2AE3D27D4EB4FULL * (2*i+1)) % n;
+  }
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+      sum += gaIMulMod(a[i], b[i], n);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * a.size());
+}
+
+/**
+ * Whether mul gives the product of mul_cyclic<0>() for a and b.
+ */
+
+static bool same_mul_cyclic52(simd_mul_cyclic52_fn mul, const std::vector<residue>& a,
+                              const std::vector<residue>& b, const montgomery& mont) {
+  const uint64_t       r = a.size();
+  std::vector<residue> c(r), expected(r);
+  mul(data(c.data()), data(a.data()), data(b.data()), r, mont);
+  mul_cyclic<0>(expected.data(), a.data(), b.data(), r, mont);
+  return c == expected;
+}
+
+static void BM_mul_cyclic52(benchmark::State& state, int kernel) {
+  const simd_mul_cyclic52_fn mul = kernel == 1 ? simd_mul_cyclic52 : simd_mul_cyclic52_fma;
+  const uint64_t             r = state.range(1);
+  montgomery                 mont(odd_modulus(state.range(0)));
+  std::vector<residue>       a(r), b(r), c(r);
+  for (uint64_t k = 0; k < r; k++) {
+    a[k] = mont.lift(k+1);
+    b[k] = mont.lift(3*k+2);
+  }
+  if (kernel && !mul) {
+    state.SkipWithError("kernel not available on this host");
+    return;
+  }
+
+  // these operands, then words at the top of [0, n) for the largest n and r
+  // the kernels take
+  if (kernel) {
+    montgomery           top(SIMD_IFMA_MAX_N-1);
+    std::vector<residue> x(SIMD_MAX_R), y(SIMD_MAX_R);
+    for (uint64_t k = 0; k < SIMD_MAX_R; k++) {
+      x[k] = top.lift(top.from(top.n-1 - k));
+      y[k] = top.lift(top.from(top.n-1 - 3*k));
+    }
+    if (!same_mul_cyclic52(mul, a, b, mont) || !same_mul_cyclic52(mul, x, y, top)) {
+        std::cout << "Sanity check failed for the " << (kernel == 1 ? "simd" : "fma")
+                  << " kernel at n = " << mont.n << ", r = " << r << "\n";
+    }
+  }
+
+  for (auto _ : state) {
+    if (kernel) {
+      mul(data(c.data()), data(a.data()), data(b.data()), r, mont);
+    } else {
+      mul_cyclic<0>(c.data(), a.data(), b.data(), r, mont);
+    }
+    benchmark::DoNotOptimize(c[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * r * r);
+}
+
+BENCHMARK(BM_mulmod)->DenseRange(20, 50, 6);
+BENCHMARK_CAPTURE(BM_mul_cyclic52, scalar, 0)->ArgsProduct({{20, 32, 44, 50}, {13, 61, SIMD_MAX_R}});
+BENCHMARK_CAPTURE(BM_mul_cyclic52, simd,   1)->ArgsProduct({{20, 32, 44, 50}, {13, 61, SIMD_MAX_R}});
+BENCHMARK_CAPTURE(BM_mul_cyclic52, fma,    2)->ArgsProduct({{20, 32, 44, 50}, {13, 61, SIMD_MAX_R}});
+
+/**
+ * Products per second by one fixed w modulo an odd n of k bits, k the
+ * argument, through gaIMulModCtx() or a gaIShoup precomputed for w; the two
+ * are checked against each other first.
+ */
+
+static void BM_mulmod_fixed(benchmark::State& state, bool shoup) {
+  const uint64_t        n = odd_modulus(state.range(0));
+  gaIModCtx             ctx;
+  gaIShoup              s;
+  std::vector<uint64_t> a(4096);
+  gaIModCtxInit(&ctx, n);
+  gaIShoupInit(&s, &ctx, n-1 - 0x9E3779B97F4A7C15ULL % (n/2));
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i] = i ? 0xC2B2AE3D27D4EB4FULL * (2*i+1) : ~0ULL;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (gaIMulShoupCtx(&ctx, a[i], &s) != gaIMulModCtx(&ctx, s.w, a[i])) {
+        std::cout << "Sanity check failed for the Shoup product mod " << n << "\n";
+        break;
+    }
+  }
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    if (shoup) {
+      for (size_t i = 0; i < a.size(); i++) {
+        sum += gaIMulShoupCtx(&ctx, a[i], &s);
+      }
+    } else {
+      for (size_t i = 0; i < a.size(); i++) {
+        sum += gaIMulModCtx(&ctx, s.w, a[i]);
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * a.size());
+}
+
+BENCHMARK_CAPTURE(BM_mulmod_fixed, ctx,   false)->DenseRange(20, 62, 6);
+BENCHMARK_CAPTURE(BM_mulmod_fixed, shoup, true )->DenseRange(20, 62, 6);
+
+/**
+ * BENCHMARK_MAIN(), plus which of the per-host kernels this run uses, so
+ * that results from different machines can be told apart.
+ */
+
+int main(int argc, char** argv) {
+  std::cerr << "Kernels: strong-fermat " << gaIIsPrimeStrongFermatKernel()
+            << ", cyclic32 "             << simd_mul_cyclic32_kernel()
+            << ", cyclic52 "             << simd_mul_cyclic52_kernel()
+            << ", ladder52 "             << simd_chebyshev52_kernel()  << "\n";
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,595 @@
+/*
+ * isprime_chebyshev() for n of any size, with the products of each step
+ * spread over a chebyshev_pool.
+ */
+
+/* Includes */
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "../include/chebyshev-big.h"
+#include "../include/chebyshev-ring.h"
+
+
+bignum::bignum(const uint64_t* n, size_t limbs) : limb(n, n+limbs)
+{
+    while(!limb.empty() && limb.back() == 0){
+        limb.pop_back();
+    }
+}
+
+int bignum::bits() const
+{
+    return limb.empty() ? 0 : 64*(int)limb.size() - __builtin_clzll(limb.back());
+}
+
+uint64_t bignum::mod(uint64_t s) const
+{
+    uint64_t x = 0;
+    for(size_t i = limb.size(); i-- > 0;){
+        x = (((unsigned __int128)x << 64) | limb[i]) % s;
+    }
+    return x;
+}
+
+montgomery_big::montgomery_big(const bignum& n) : k(n.size()), n(n.limb), one(n.size(), 0)
+{
+    // Newton's iteration, from the 3 bits x = n gets right for odd n
+    uint64_t x = n.limb[0];
+    for(int i = 0; i < 5; i++){
+        x *= 2 - n.limb[0]*x;
+    }
+    ninv = 0-x;
+
+    // R mod n: 2^(b-1) < n for b-bit n, doubled up to 2^64(k+1)
+    const int b = n.bits();
+    one[(b-1)/64] = 1ULL << ((b-1)%64);
+    for(int i = b-1; i < 64*(int)(k+1); i++){
+        add(&one[0], &one[0], &one[0]);
+    }
+}
+
+void montgomery_big::add(uint64_t* out, const uint64_t* a, const uint64_t* b) const
+{
+    unsigned char carry = 0;
+    for(size_t i = 0; i < k; i++){
+        out[i] = limb_add(a[i], b[i], carry);
+    }
+
+    size_t i = k;
+    while(!carry && i-- > 0 && out[i] == n[i]){}
+    if(carry || i == (size_t)-1 || out[i] > n[i]){
+        unsigned char borrow = 0;
+        for(size_t j = 0; j < k; j++){
+            out[j] = limb_sub(out[j], n[j], borrow);
+        }
+    }
+}
+
+void montgomery_big::sub(uint64_t* out, const uint64_t* a, const uint64_t* b) const
+{
+    unsigned char borrow = 0;
+    for(size_t i = 0; i < k; i++){
+        out[i] = limb_sub(a[i], b[i], borrow);
+    }
+    if(borrow){
+        unsigned char carry = 0;
+        for(size_t i = 0; i < k; i++){
+            out[i] = limb_add(out[i], n[i], carry);
+        }
+    }
+}
+
+void montgomery_big::redc(uint64_t* out, uint64_t* t) const
+{
+    // k+1 one-limb steps, each adding the multiple of n that clears t[i]
+    for(size_t i = 0; i <= k; i++){
+        const uint64_t m = t[i]*ninv;
+        uint64_t       c = 0;
+        for(size_t j = 0; j < k; j++){
+            unsigned __int128 p = (unsigned __int128)m * n[j] + t[i+j] + c;
+            t[i+j] = (uint64_t)p;
+            c      = (uint64_t)(p >> 64);
+        }
+        for(size_t j = i+k; c && j < 2*k+2; j++){
+            t[j] += c;
+            c     = t[j] < c;
+        }
+    }
+
+    // t/R, now in t[k+1..2k+2), is below 2n
+    const uint64_t* s = t+k+1;
+    size_t          i = k;
+    if(!s[k]){
+        while(i-- > 0 && s[i] == n[i]){}
+    }
+    if(s[k] || i == (size_t)-1 || s[i] > n[i]){
+        unsigned char borrow = 0;
+        for(size_t j = 0; j < k; j++){
+            out[j] = limb_sub(s[j], n[j], borrow);
+        }
+    }else{
+        memcpy(out, s, k*sizeof(uint64_t));
+    }
+}
+
+/**
+ * The schoolbook product and square of m-limb integers into out[0..2m).
+ * The square forms each cross product a[i] a[j] once and doubles their sum.
+ */
+
+static void mul_schoolbook(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t m)
+{
+    memset(out, 0, 2*m*sizeof(uint64_t));
+    for(size_t i = 0; i < m; i++){
+        uint64_t c = 0;
+        for(size_t j = 0; j < m; j++){
+            unsigned __int128 p = (unsigned __int128)a[i] * b[j] + out[i+j] + c;
+            out[i+j] = (uint64_t)p;
+            c        = (uint64_t)(p >> 64);
+        }
+        out[i+m] = c;
+    }
+}
+
+static void sqr_schoolbook(uint64_t* out, const uint64_t* a, size_t m)
+{
+    memset(out, 0, 2*m*sizeof(uint64_t));
+    for(size_t i = 0; i < m; i++){
+        uint64_t c = 0;
+        for(size_t j = i+1; j < m; j++){
+            unsigned __int128 p = (unsigned __int128)a[i] * a[j] + out[i+j] + c;
+            out[i+j] = (uint64_t)p;
+            c        = (uint64_t)(p >> 64);
+        }
+        out[i+m] = c;
+    }
+
+    uint64_t      top   = 0;
+    unsigned char carry = 0;
+    for(size_t i = 0; i < 2*m; i++){
+        const uint64_t x = out[i];
+        out[i] = x << 1 | top;
+        top    = x >> 63;
+    }
+    for(size_t i = 0; i < m; i++){
+        unsigned __int128 p = (unsigned __int128)a[i] * a[i];
+        out[2*i  ] = limb_add(out[2*i  ], (uint64_t) p,        carry);
+        out[2*i+1] = limb_add(out[2*i+1], (uint64_t)(p >> 64), carry);
+    }
+}
+
+/**
+ * Sets out to |x - y| for the h-limb x and l-limb y, l <= h, and returns
+ * whether x < y.
+ */
+
+static bool sub_abs(uint64_t* out, const uint64_t* x, size_t h, const uint64_t* y, size_t l)
+{
+    bool less = false;
+    for(size_t i = h; i-- > 0;){
+        const uint64_t yi = i < l ? y[i] : 0;
+        if(x[i] != yi){
+            less = x[i] < yi;
+            break;
+        }
+    }
+
+    unsigned char borrow = 0;
+    for(size_t i = 0; i < h; i++){
+        const uint64_t yi = i < l ? y[i] : 0;
+        out[i] = less ? limb_sub(yi, x[i], borrow) : limb_sub(x[i], yi, borrow);
+    }
+    return less;
+}
+
+size_t big_mul_scratch(size_t m)
+{
+    if(m < BIG_KARATSUBA_THRESHOLD || m >= BIG_NTT_THRESHOLD){
+        return 0;
+    }
+    const size_t h = (m+1)/2;
+    const size_t s = big_mul_scratch(h);
+    return 4*h + std::max(s, 2*h+1);
+}
+
+/**
+ * The middle term of Karatsuba's split of an m-limb product into halves of
+ * h = ceil(m/2) and l limbs, once z0 = a0*b0 is in out[0..2h), z2 = a1*b1
+ * in out[2h..2m), and d = |a0-a1| |b0-b1| in 2h limbs: adds to out
+ *
+ *     X^h (z0 + z2 - (a0-a1)(b0-b1))
+ *
+ * taking d with the sign of the differences, negative when their product
+ * is, so that no sum ever carries out of its limbs. t holds 2h+1 limbs.
+ */
+
+static void karatsuba_middle(uint64_t* out, size_t m, const uint64_t* d, bool negative, uint64_t* t)
+{
+    const size_t h = (m+1)/2;
+    const size_t l = m-h;
+
+    // t = z0 + z2 -+ d, which is nonnegative
+    unsigned char carry = 0, borrow = 0;
+    for(size_t i = 0; i < 2*h; i++){
+        t[i] = limb_add(out[i], i < 2*l ? out[2*h+i] : 0, carry);
+    }
+    t[2*h] = carry;
+    carry  = 0;
+    for(size_t i = 0; i <= 2*h; i++){
+        t[i] = negative ? limb_add(t[i], i < 2*h ? d[i] : 0, carry) :
+                          limb_sub(t[i], i < 2*h ? d[i] : 0, borrow);
+    }
+
+    carry = 0;
+    for(size_t i = 0; i <= 2*h; i++){
+        out[h+i] = limb_add(out[h+i], t[i], carry);
+    }
+    for(size_t i = 3*h+1; carry && i < 2*m; i++){
+        out[i] = limb_add(out[i], 0, carry);
+    }
+}
+
+void big_mul_ntt(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t m)
+{
+    const ntt_plan* ntt = thread_workspace().plan(m);
+    buffer<0>       T(2*ntt->words());
+
+    for(int i = 0; i < NTT_NUM_PRIMES; i++){
+        ntt->product(T.data(), T.data() + ntt->words(), a, b, i);
+    }
+    ntt->carry(out, T.data());
+}
+
+void big_mul(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t m, uint64_t* scratch)
+{
+    const bool sq = a == b;
+
+    if(m >= BIG_NTT_THRESHOLD){
+        big_mul_ntt(out, a, b, m);
+        return;
+    }
+
+    if(m < BIG_KARATSUBA_THRESHOLD){
+        if(sq){
+            sqr_schoolbook(out, a, m);
+        }else{
+            mul_schoolbook(out, a, b, m);
+        }
+        return;
+    }
+
+    /* a = a0 + X^h a1,  b = b0 + X^h b1,  a0,b0 of h limbs, a1,b1 of l <= h */
+
+    const size_t h = (m+1)/2;
+    const size_t l = m-h;
+    uint64_t* da = scratch;
+    uint64_t* db = da + h;
+    uint64_t* d  = db + h;
+    uint64_t* t  = d + 2*h;
+
+    big_mul(out,     a,   b,   h, t);
+    big_mul(out+2*h, a+h, b+h, l, t);
+
+    bool negative = sub_abs(da, a, h, a+h, l);
+    if(sq){
+        negative = false;
+        big_mul(d, da, da, h, t);
+    }else{
+        negative ^= sub_abs(db, b, h, b+h, l);
+        big_mul(d, da, db, h, t);
+    }
+
+    karatsuba_middle(out, m, d, negative, t);
+}
+
+/**
+ * Cyclic product mod x^r - 1 by Kronecker substitution: each operand is
+ * packed into one integer with a coefficient every w = 2k+1 limbs, so that
+ * a single product gives every coefficient of the linear product in its
+ * own w limbs, which hold fewer than 2^64 products of residues. Folding
+ * x^(r+j) onto x^j and one redc() per coefficient finish it.
+ *
+ * It is taken in three steps, for the products of a ladder step or matrix
+ * square to run together on a pool: big_pack() packs the operands and
+ * takes the differences of their halves, big_part() is one of the three
+ * half-size products of Karatsuba's split at the top, and big_fold()
+ * combines them, folds and reduces. So a job of c products has 3c parts
+ * of about equal cost. From BIG_NTT_THRESHOLD limbs the parts are instead
+ * the three primes of the NTT product, and big_fold() starts with the
+ * carry() that rebuilds the integer.
+ */
+
+typedef struct big_product
+{
+    uint64_t*       out;
+    const uint64_t* a;
+    const uint64_t* b;          /* a itself for a square */
+
+    uint64_t*       A;          /* a and b packed, N limbs each */
+    uint64_t*       B;
+    uint64_t*       C;          /* their product, 2N limbs */
+    uint64_t*       da;         /* |A0 - A1|, |B0 - B1| and their product */
+    uint64_t*       db;
+    uint64_t*       d;
+    uint64_t*       t;          /* sums, max(2h+1, 2k+2) limbs */
+    bool            negative;
+    uint64_t*       X;          /* or the transforms, ntt_plan::words() each */
+    uint64_t*       Y;
+} big_product;
+
+/**
+ * Limbs of the buffers of one big_product.
+ */
+
+static size_t big_product_limbs(uint64_t r, size_t k, const ntt_plan* ntt)
+{
+    const size_t N = r*(2*k+1), h = (N+1)/2;
+    return ntt ? 4*N + 2*ntt->words() + 2*k+2 : 4*N + 4*h + std::max(2*h+1, 2*k+2);
+}
+
+static void big_pack(big_product& p, uint64_t r, size_t k, uint64_t* buffer, const ntt_plan* ntt)
+{
+    const size_t w  = 2*k+1;
+    const size_t N  = r*w, h = (N+1)/2, l = N-h;
+    const bool   sq = p.a == p.b;
+
+    p.A  = buffer;
+    p.B  = sq ? p.A : p.A + N;
+    p.C  = p.A + 2*N;
+    p.da = p.C + 2*N;
+    p.db = p.da + h;
+    p.d  = p.db + h;
+    p.t  = p.d + 2*h;
+    if(ntt){
+        p.X = p.C + 2*N;
+        p.Y = p.X + ntt->words();
+        p.t = p.Y + ntt->words();
+    }
+
+    memset(p.A, 0, (sq ? 1 : 2)*N*sizeof(uint64_t));
+    for(uint64_t i = 0; i < r; i++){
+        memcpy(p.A + i*w, p.a + i*k, k*sizeof(uint64_t));
+        if(!sq){
+            memcpy(p.B + i*w, p.b + i*k, k*sizeof(uint64_t));
+        }
+    }
+
+    if(!ntt && N >= BIG_KARATSUBA_THRESHOLD){
+        p.negative = sub_abs(p.da, p.A, h, p.A+h, l);
+        if(sq){
+            p.negative = false;
+        }else{
+            p.negative ^= sub_abs(p.db, p.B, h, p.B+h, l);
+        }
+    }
+}
+
+static void big_part(const big_product& p, int which, uint64_t r, size_t k, const ntt_plan* ntt)
+{
+    const size_t N = r*(2*k+1), h = (N+1)/2, l = N-h;
+
+    if(ntt){
+        ntt->product(p.X, p.Y, p.A, p.B, which);
+        return;
+    }
+    if(N < BIG_KARATSUBA_THRESHOLD){
+        if(which == 0){
+            big_mul(p.C, p.A, p.B, N, NULL);
+        }
+        return;
+    }
+
+    buffer<0> scratch(big_mul_scratch(h));
+    switch(which){
+        case 0: big_mul(p.C,     p.A,   p.B,   h, scratch.data());                    break;
+        case 1: big_mul(p.C+2*h, p.A+h, p.B+h, l, scratch.data());                    break;
+        case 2: big_mul(p.d, p.da, p.A == p.B ? p.da : p.db, h, scratch.data());     break;
+    }
+}
+
+static void big_fold(const big_product& p, uint64_t r, const montgomery_big& m, const ntt_plan* ntt)
+{
+    const size_t w = 2*m.k+1, N = r*w;
+
+    if(ntt){
+        ntt->carry(p.C, p.X);
+    }else if(N >= BIG_KARATSUBA_THRESHOLD){
+        karatsuba_middle(p.C, N, p.d, p.negative, p.t);
+    }
+
+    for(uint64_t j = 0; j < r; j++){
+        unsigned char carry = 0;
+        for(size_t i = 0; i < w; i++){
+            p.t[i] = limb_add(p.C[j*w + i], j+r < 2*r-1 ? p.C[(j+r)*w + i] : 0, carry);
+        }
+        p.t[w] = carry;
+        m.redc(p.out + j*m.k, p.t);
+    }
+}
+
+/**
+ * Up to five cyclic products, of r coefficients of k limbs, run as one
+ * job; the caller sets out, a and b of each, b equal to a for a square.
+ * big_run() sets ntt, the plan of the packed length, where that reaches
+ * BIG_NTT_THRESHOLD.
+ */
+
+typedef struct big_job
+{
+    const montgomery_big* m;
+    uint64_t              r;
+    big_product           product[5];
+    const ntt_plan*       ntt;
+} big_job;
+
+static void big_job_part(void* context, size_t i)
+{
+    // three parts a product: Karatsuba's three, or the NTT_NUM_PRIMES = 3 primes
+    const big_job* job = (const big_job*)context;
+    big_part(job->product[i/3], i%3, job->r, job->m->k, job->ntt);
+}
+
+static void big_job_fold(void* context, size_t i)
+{
+    const big_job* job = (const big_job*)context;
+    big_fold(job->product[i], job->r, *job->m, job->ntt);
+}
+
+static void big_run(big_job& job, size_t count, chebyshev_pool* pool)
+{
+    const size_t N = job.r*(2*job.m->k+1);
+    job.ntt = N >= BIG_NTT_THRESHOLD ? thread_workspace().plan(N) : NULL;
+
+    const size_t limbs = big_product_limbs(job.r, job.m->k, job.ntt);
+    buffer<0>    buffers(count*limbs);
+
+    for(size_t i = 0; i < count; i++){
+        big_pack(job.product[i], job.r, job.m->k, buffers.data() + i*limbs, job.ntt);
+    }
+
+    if(pool){
+        pool->run(&big_job_part, &job, 3*count);
+        pool->run(&big_job_fold, &job,   count);
+    }else{
+        for(size_t i = 0; i < 3*count; i++){
+            big_job_part(&job, i);
+        }
+        for(size_t i = 0; i < count; i++){
+            big_job_fold(&job, i);
+        }
+    }
+}
+
+/**
+ * chebyshev_ladder() on montgomery_big, the square and the product of each
+ * step being one job of two parts. Tn is left in Tk.
+ */
+
+static void chebyshev_ladder_big(const bignum& n, uint64_t r, const montgomery_big& m,
+                                 chebyshev_pool* pool, std::vector<uint64_t>& Tk)
+{
+    const size_t          k = m.k;
+    std::vector<uint64_t> Tk1(r*k, 0), cross(r*k), sq(r*k);
+    big_job               job = {&m, r, {}, NULL};
+
+    Tk.assign(r*k, 0);
+    std::copy(m.one.begin(), m.one.end(), &Tk [0]);// T_0 = 1
+    std::copy(m.one.begin(), m.one.end(), &Tk1[k]);// T_1 = x
+
+    for(int i = n.bits()-1; i >= 0; i--){
+        const bool one = n.bit(i);
+        big_product* p = job.product;
+        p[0].out = &cross[0]; p[0].a = &Tk[0];                 p[0].b = &Tk1[0];
+        p[1].out = &sq   [0]; p[1].a = one ? &Tk1[0] : &Tk[0]; p[1].b = p[1].a;
+        big_run(job, 2, pool);
+
+        // 2*cross - x and 2*sq - 1
+        for(uint64_t j = 0; j < r; j++){
+            m.add(&cross[j*k], &cross[j*k], &cross[j*k]);
+            m.add(&sq   [j*k], &sq   [j*k], &sq   [j*k]);
+        }
+        m.sub(&cross[k], &cross[k], &m.one[0]);
+        m.sub(&sq   [0], &sq   [0], &m.one[0]);
+
+        if(one){
+            Tk .swap(cross);
+            Tk1.swap(sq);
+        }else{
+            Tk .swap(sq);
+            Tk1.swap(cross);
+        }
+    }
+}
+
+/**
+ * chebyshev_matrix_sparse() on montgomery_big. The matrix entries p00 p01
+ * p10 p11 sit back to back, r coefficients of k limbs each, and the five
+ * products of a square are one job. Tn is left in Tn.
+ */
+
+static void chebyshev_matrix_big(const bignum& n, uint64_t r, const montgomery_big& m,
+                                 chebyshev_pool* pool, std::vector<uint64_t>& Tn)
+{
+    const size_t          k = m.k, e = r*k;
+    std::vector<uint64_t> a(4*e, 0), b(4*e), trace(e), bc(e);
+    std::vector<uint64_t> zero(k, 0);
+    uint64_t*             powered = &a[0];
+    uint64_t*             spare   = &b[0];
+
+    // the base; the top bit of n-1 leaves it
+    m.add(&a[k],   &m.one[0], &m.one[0]);  // p00 = 2x
+    m.sub(&a[e],   &zero[0],  &m.one[0]);  // p01 = -1
+    std::copy(m.one.begin(), m.one.end(), &a[2*e]);// p10 = 1
+
+    // n-1 has the bits of n but for bit 0
+    for(int i = n.bits()-2; i >= 0; i--){
+        const uint64_t *p00 = powered, *p01 = p00+e, *p10 = p01+e, *p11 = p10+e;
+        uint64_t       *q00 = spare,   *q01 = q00+e, *q10 = q01+e, *q11 = q10+e;
+
+        // | p00^2+p01*p10  p01*(p00+p11) |
+        // | p10*(p00+p11)  p11^2+p01*p10 |
+        for(uint64_t j = 0; j < r; j++){
+            m.add(&trace[j*k], p00 + j*k, p11 + j*k);
+        }
+        big_job      job = {&m, r, {}, NULL};
+        big_product* p   = job.product;
+        p[0].out = &bc[0]; p[0].a = p01; p[0].b = p10;
+        p[1].out = q00;    p[1].a = p00; p[1].b = p00;
+        p[2].out = q01;    p[2].a = p01; p[2].b = &trace[0];
+        p[3].out = q10;    p[3].a = p10; p[3].b = &trace[0];
+        p[4].out = q11;    p[4].a = p11; p[4].b = p11;
+        big_run(job, 5, pool);
+        for(uint64_t j = 0; j < r; j++){
+            m.add(q00 + j*k, q00 + j*k, &bc[j*k]);
+            m.add(q11 + j*k, q11 + j*k, &bc[j*k]);
+        }
+
+        if(i > 0 && n.bit(i)){
+            // times | 2x -1 |, a shift and a few adds
+            //       |  1  0 |
+            for(int row = 0; row < 2; row++){
+                const uint64_t *x = q00 + 2*row*e, *y = x+e;
+                uint64_t       *u = powered + 2*row*e, *v = u+e;
+                for(uint64_t j = 0; j < r; j++){
+                    const uint64_t* xs = x + (j ? j-1 : r-1)*k;
+                    m.add(u + j*k, xs,      xs);
+                    m.add(u + j*k, u + j*k, y + j*k);
+                    m.sub(v + j*k, &zero[0], x + j*k);
+                }
+            }
+        }else{
+            std::swap(powered, spare);
+        }
+    }
+
+    // Tn = p00*x + p01*1
+    Tn.resize(e);
+    for(uint64_t j = 0; j < r; j++){
+        m.add(&Tn[j*k], powered + (j ? j-1 : r-1)*k, powered + e + j*k);
+    }
+}
+
+bool chebyshev_congruence_big(const bignum& n, uint64_t r, chebyshev_engine engine,
+                              chebyshev_pool* pool)
+{
+    const montgomery_big  m(n);
+    std::vector<uint64_t> Tn;
+
+    if(engine == CHEBYSHEV_LADDER){
+        chebyshev_ladder_big(n, r, m, pool, Tn);
+    }else{
+        chebyshev_matrix_big(n, r, m, pool, Tn);
+    }
+
+    // as congruent_to_x_n(), in Montgomery form
+    const uint64_t x = n.mod(r);
+    for(uint64_t j = 0; j < r; j++){
+        for(size_t i = 0; i < m.k; i++){
+            if(Tn[j*m.k + i] != (j == x ? m.one[i] : 0)){
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,342 @@
+/*
+ * Number-theoretic-transform multiplication in Z_n[x]/(x^r - 1).
+ */
+
+/* Includes */
+#include "../include/chebyshev-ntt.h"
+#include "../include/primality-test-baseline.h"
+
+
+/**
+ * NTT-friendly primes p = c*2^32 + 1 < 2^62 with a primitive root g, and the
+ * Montgomery constants derived from them.
+ *
+ * Keeping p below 2^62 leaves room to skip the carry out of t + m*p in
+ * redc() and to reduce any 64-bit input with a single redc().
+ */
+
+typedef struct ntt_prime
+{
+    uint64_t p;
+    uint64_t g;
+    uint64_t pinv;          /* -p^-1 mod 2^64 */
+    uint64_t r2;            /* 2^128 mod p    */
+} ntt_prime;
+
+static ntt_prime make_prime(uint64_t p, uint64_t g){
+    ntt_prime P;
+    uint64_t  inv = p;
+    int       i;
+
+    /* Newton's iteration doubles the number of correct low bits each step. */
+    for(i=0;i<5;i++){
+        inv *= 2 - p*inv;
+    }
+
+    uint64_t r1 = (uint64_t)(((unsigned __int128)1 << 64) % p);
+
+    P.p    = p;
+    P.g    = g;
+    P.pinv = -inv;
+    P.r2   = (uint64_t)((unsigned __int128)r1 * r1 % p);
+    return P;
+}
+
+static inline uint64_t redc(unsigned __int128 t, const ntt_prime& P){
+    uint64_t m = (uint64_t)t * P.pinv;
+    uint64_t u = (uint64_t)((t + (unsigned __int128)m * P.p) >> 64);
+    return u >= P.p ? u-P.p : u;
+}
+
+static inline uint64_t mulm(uint64_t a, uint64_t b, const ntt_prime& P){
+    return redc((unsigned __int128)a * b, P);
+}
+
+/**
+ * Shoup's product by a fixed multiplier: h = floor(a*q / 2^64) is the
+ * quotient of a*w by p or one less, so a*w - h*p, formed mod 2^64, lies in
+ * [0, 2p) and needs one conditional subtraction. It keeps the form of a: a
+ * plain w leaves a Montgomery-form a in Montgomery form.
+ */
+
+static inline ntt_shoup shoup(uint64_t w, const ntt_prime& P){
+    ntt_shoup S;
+
+    S.w = w;
+    S.q = (uint64_t)(((unsigned __int128)w << 64) / P.p);
+    return S;
+}
+
+static inline uint64_t mulm(uint64_t a, const ntt_shoup& S, const ntt_prime& P){
+    uint64_t h = (uint64_t)(((unsigned __int128)a * S.q) >> 64);
+    uint64_t t = a*S.w - h*P.p;
+    return t >= P.p ? t-P.p : t;
+}
+
+static inline uint64_t addm(uint64_t a, uint64_t b, const ntt_prime& P){
+    uint64_t s = a+b;
+    return s >= P.p ? s-P.p : s;
+}
+
+static inline uint64_t subm(uint64_t a, uint64_t b, const ntt_prime& P){
+    return a >= b ? a-b : a-b+P.p;
+}
+
+static uint64_t powm(uint64_t x, uint64_t e, const ntt_prime& P){
+    uint64_t y = redc(P.r2, P);     /* 1 in Montgomery form */
+
+    while(e){
+        if(e & 1){
+            y = mulm(y, x, P);
+        }
+        x = mulm(x, x, P);
+        e >>= 1;
+    }
+
+    return y;
+}
+
+typedef struct ntt_constants
+{
+    ntt_constants(){
+        P[0] = make_prime(4611685941117976577ULL,  3);
+        P[1] = make_prime(4611685692009873409ULL, 19);
+        P[2] = make_prime(4611685606110527489ULL,  3);
+
+        /* Inverses by Fermat's little theorem; redc() takes them out of Montgomery form. */
+        inv12 = shoup(redc(powm(mulm(P[0].p, P[1].r2, P[1]), P[1].p-2, P[1]), P[1]), P[1]);
+        inv13 = shoup(redc(powm(mulm(P[0].p, P[2].r2, P[2]), P[2].p-2, P[2]), P[2]), P[2]);
+        inv23 = shoup(redc(powm(mulm(P[1].p, P[2].r2, P[2]), P[2].p-2, P[2]), P[2]), P[2]);
+
+        for(int i=0;i<NTT_NUM_PRIMES;i++){
+            R[i] = shoup(redc(P[i].r2, P[i]), P[i]);
+        }
+    }
+
+    ntt_prime P[NTT_NUM_PRIMES];
+    ntt_shoup R[NTT_NUM_PRIMES];  /* 2^64 mod p, into Montgomery form */
+    ntt_shoup inv12;        /* p1^-1 mod p2 */
+    ntt_shoup inv13;        /* p1^-1 mod p3 */
+    ntt_shoup inv23;        /* p2^-1 mod p3 */
+} ntt_constants;
+
+static const ntt_constants& constants(){
+    static const ntt_constants C;
+    return C;
+}
+
+
+/**
+ * Method Definitions
+ */
+
+ntt_plan::ntt_plan(uint64_t r, const montgomery& mont) : r(r), mont(mont){
+    const ntt_constants& C = constants();
+
+    for(logL=0, L=1; L < 2*r-1; logL++, L<<=1){}
+
+    rebind(mont);
+
+    for(int i=0;i<NTT_NUM_PRIMES;i++){
+        const ntt_prime& P = C.P[i];
+        uint64_t wL  = powm(mulm(P.g, P.r2, P), (P.p-1) >> logL, P);
+        uint64_t wLi = powm(wL, P.p-2, P);
+        uint64_t wk  = redc(P.r2, P);
+        uint64_t wki = wk;
+
+        /* Powers are stepped in Montgomery form and stored plain. */
+        w   [i].resize(L/2);
+        winv[i].resize(L/2);
+        for(uint64_t k=0;k<L/2;k++){
+            w   [i][k] = shoup(redc(wk,  P), P);
+            winv[i][k] = shoup(redc(wki, P), P);
+            wk  = mulm(wk,  wL,  P);
+            wki = mulm(wki, wLi, P);
+        }
+
+        /**
+         * L * (p-1)/L = -1 mod p gives 1/L; redc() of it is 1/(LR), which
+         * also takes inverse() out of Montgomery form.
+         */
+
+        Linv[i] = shoup(redc(P.p - ((P.p-1) >> logL), P), P);
+    }
+}
+
+ntt_plan::ntt_plan(uint64_t r) : ntt_plan(r, montgomery(1)){}
+
+void ntt_plan::rebind(const montgomery& mont){
+    const ntt_constants& C = constants();
+
+    this->mont = mont;
+    p1modn     = gaIModCtxReduce(&mont, C.P[0].p);
+    p12modn    = gaIMulModCtx(&mont, p1modn, C.P[1].p);
+}
+
+void ntt_plan::forward(uint64_t* A, const uint64_t* a) const{
+    for(int i=0;i<NTT_NUM_PRIMES;i++){
+        forward(A + i*L, a, i);
+    }
+}
+
+/**
+ * Transform mod the i-th prime: a[] into its block X[] of L words.
+ */
+
+void ntt_plan::forward(uint64_t* X, const uint64_t* a, int i) const{
+    const ntt_constants& C  = constants();
+    const ntt_prime&     P  = C.P[i];
+    const ntt_shoup*     wi = &w[i][0];
+
+    for(uint64_t k=0;k<r;k++){
+        X[k] = mulm(a[k], C.R[i], P);
+    }
+    for(uint64_t k=r;k<L;k++){
+        X[k] = 0;
+    }
+
+    /* Decimation in frequency: natural order in, bit-reversed out. */
+    for(uint64_t len=L/2, stride=1; len>=1; len>>=1, stride<<=1){
+        for(uint64_t s=0;s<L;s+=2*len){
+            for(uint64_t j=0;j<len;j++){
+                uint64_t u = X[s+j];
+                uint64_t v = X[s+j+len];
+                X[s+j]     = addm(u, v, P);
+                X[s+j+len] = mulm(subm(u, v, P), wi[j*stride], P);
+            }
+        }
+    }
+}
+
+/**
+ * The inverse transform mod the i-th prime, of its block X[], unscaled.
+ */
+
+void ntt_plan::backward(uint64_t* X, int i) const{
+    const ntt_prime& P  = constants().P[i];
+    const ntt_shoup* wi = &winv[i][0];
+
+    /* Decimation in time: bit-reversed in, natural order out. */
+    for(uint64_t len=1, stride=L/2; len<L; len<<=1, stride>>=1){
+        for(uint64_t s=0;s<L;s+=2*len){
+            for(uint64_t j=0;j<len;j++){
+                uint64_t u = X[s+j];
+                uint64_t v = mulm(X[s+j+len], wi[j*stride], P);
+                X[s+j]     = addm(u, v, P);
+                X[s+j+len] = subm(u, v, P);
+            }
+        }
+    }
+}
+
+/**
+ * Garner's algorithm: the exact value with residues x1, x2, x3 is
+ * v1 + p1*v2 + p1*p2*v3 with v_i < p_i, v1 = x1.
+ */
+
+static inline void garner(uint64_t x1, uint64_t x2, uint64_t x3, uint64_t& v2, uint64_t& v3){
+    const ntt_constants& K  = constants();
+    const ntt_prime&     P2 = K.P[1];
+    const ntt_prime&     P3 = K.P[2];
+
+    v2 = mulm(subm(x2, x1 >= P2.p ? x1-P2.p : x1, P2), K.inv12, P2);
+    uint64_t t = mulm(subm(x3, x1 >= P3.p ? x1-P3.p : x1, P3), K.inv13, P3);
+    v3 = mulm(subm(t,  v2 >= P3.p ? v2-P3.p : v2, P3), K.inv23, P3);
+}
+
+void ntt_plan::mul    (uint64_t* C, const uint64_t* A, const uint64_t* B) const{
+    const ntt_constants& K = constants();
+
+    for(int i=0;i<NTT_NUM_PRIMES;i++){
+        const ntt_prime& P = K.P[i];
+        for(uint64_t k=i*L;k<(i+1)*L;k++){
+            C[k] = mulm(A[k], B[k], P);
+        }
+    }
+}
+
+void ntt_plan::muladd (uint64_t* C, const uint64_t* A, const uint64_t* B) const{
+    const ntt_constants& K = constants();
+
+    for(int i=0;i<NTT_NUM_PRIMES;i++){
+        const ntt_prime& P = K.P[i];
+        for(uint64_t k=i*L;k<(i+1)*L;k++){
+            C[k] = addm(C[k], mulm(A[k], B[k], P), P);
+        }
+    }
+}
+
+void ntt_plan::inverse(uint64_t* c, uint64_t* C) const{
+    const ntt_constants& K = constants();
+
+    for(int i=0;i<NTT_NUM_PRIMES;i++){
+        const ntt_prime& P = K.P[i];
+        uint64_t*        X = C + i*L;
+
+        backward(X, i);
+
+        /* The linear product has 2r-1 coefficients; x^(r+k) folds onto x^k. */
+
+        for(uint64_t k=0;k<r;k++){
+            uint64_t y = k+r < 2*r-1 ? addm(X[k], X[k+r], P) : X[k];
+            X[k] = mulm(y, Linv[i], P);
+        }
+    }
+
+    /**
+     * The exact coefficient is then reduced mod n. Reducing each term of
+     * Garner's sum with redc() instead of a division also divides out the
+     * surplus factor R.
+     */
+
+    for(uint64_t k=0;k<r;k++){
+        uint64_t v1 = C[k], v2, v3;
+        garner(v1, C[L+k], C[2*L+k], v2, v3);
+
+        c[k] = mont.add(mont.redc(v1), mont.add(mont.mul(v2, p1modn),
+                                                mont.mul(v3, p12modn)));
+    }
+}
+
+void ntt_plan::product(uint64_t* C, uint64_t* T, const uint64_t* a, const uint64_t* b, int i) const{
+    const ntt_prime& P = constants().P[i];
+    uint64_t*        X = C + i*L;
+    uint64_t*        Y = T + i*L;
+
+    forward(X, a, i);
+    if(b != a){
+        forward(Y, b, i);
+    }else{
+        Y = X;
+    }
+    for(uint64_t k=0;k<L;k++){
+        X[k] = mulm(X[k], Y[k], P);
+    }
+    backward(X, i);
+
+    /* All 2r-1 coefficients of the linear product, with 1/(LR) as above. */
+    for(uint64_t k=0;k<2*r-1;k++){
+        X[k] = mulm(X[k], Linv[i], P);
+    }
+}
+
+void ntt_plan::carry(uint64_t* c, const uint64_t* C) const{
+    const ntt_constants&    K    = constants();
+    const uint64_t          p1   = K.P[0].p;
+    const unsigned __int128 p12  = (unsigned __int128)p1 * K.P[1].p;
+    unsigned __int128       high = 0;   /* the sums so far, past c[k] */
+
+    for(uint64_t k=0;k<2*r-1;k++){
+        uint64_t v1 = C[k], v2, v3;
+        garner(v1, C[L+k], C[2*L+k], v2, v3);
+
+        /* v1 + p1 v2 < 2^125 and p1 p2 v3 < 2^186, as limbs lo and mid:hi */
+        unsigned __int128 lo  = (unsigned __int128)p1 * v2 + v1 + (uint64_t)p12 * (unsigned __int128)v3;
+        unsigned __int128 mid = (unsigned __int128)(uint64_t)(p12 >> 64) * v3;
+        unsigned __int128 t   = (unsigned __int128)(uint64_t)lo + (uint64_t)high;
+
+        c[k] = (uint64_t)t;
+        high = (high >> 64) + (lo >> 64) + mid + (t >> 64);
+    }
+    c[2*r-1] = (uint64_t)high;
+}
@@ -0,0 +1,267 @@
+/*
+ * Segmented sieve of Eratosthenes checking primality tests over ranges.
+ */
+
+/* Includes */
+#include <cmath>
+#include <vector>
+#include "../include/chebyshev-montgomery.h"
+#include "../include/chebyshev-oracle.h"
+#include "../include/primality-test-baseline.h"
+
+
+/**
+ * Largest r with r*r <= n.
+ */
+
+static uint64_t isqrt(uint64_t n)
+{
+    uint64_t r = (uint64_t)sqrtl((long double)n);
+    while(r*r > n){
+        r--;
+    }
+    while((r+1)*(r+1) <= n && r+1 < (1ULL << 32)){
+        r++;
+    }
+    return r;
+}
+
+prime_oracle::prime_oracle(uint64_t hi) : root(0)
+{
+    const uint64_t need = hi ? isqrt(hi-1) : 0;
+    if(need > ORACLE_MAX_ROOT){
+        return;
+    }
+
+    // plain sieve of the odd numbers up to need, c[i] for 2i+1
+    std::vector<uint8_t> c(need/2+1, 0);
+    for(uint64_t i = 1; (2*i+1)*(2*i+1) <= need; i++){
+        if(!c[i]){
+            for(uint64_t j = (2*i+1)*(2*i+1)/2; j <= need/2; j += 2*i+1){
+                c[j] = 1;
+            }
+        }
+    }
+    for(uint64_t i = 1; 2*i+1 <= need; i++){
+        if(!c[i]){
+            primes.push_back(2*i+1);
+        }
+    }
+    root = need;
+}
+
+bool prime_oracle::sieves(uint64_t lo, uint64_t hi) const
+{
+    return hi > lo && (hi <= 1 || isqrt(hi-1) <= root) && hi - lo >= primes.size();
+}
+
+void prime_oracle::range(uint64_t lo, uint64_t hi, uint8_t* prime) const
+{
+    if(!sieves(lo, hi)){
+        for(uint64_t n = lo; n < hi; n++){
+            prime[n-lo] = gaIIsPrime(n) != 0;
+        }
+        return;
+    }
+
+    /*
+     * Bit j of a segment stands for the odd number first + 2j. Each odd
+     * prime p crosses off its odd multiples from max(p^2, the first in
+     * the segment) on; the bits left are the odd primes, but for 1.
+     */
+
+    std::vector<uint64_t> bits(ORACLE_SEGMENT_BITS/64);
+    const uint64_t        odd = lo | 1;
+
+    for(uint64_t first = odd; first < hi; first += 2*ORACLE_SEGMENT_BITS){
+        const uint64_t span = (hi - first + 1)/2 < ORACLE_SEGMENT_BITS ? (hi - first + 1)/2 :
+                                                                         ORACLE_SEGMENT_BITS;
+        const uint64_t last = first + 2*(span-1);
+
+        bits.assign(bits.size(), 0);
+        for(size_t k = 0; k < primes.size(); k++){
+            const uint64_t p = primes[k];
+            if(p*p > last){
+                break;
+            }
+
+            uint64_t m = p*p >= first ? p*p : (first + p-1)/p*p;
+            if(~m & 1){
+                m += p;
+            }
+            for(uint64_t j = (m - first)/2; j < span; j += p){
+                bits[j >> 6] |= 1ULL << (j & 63);
+            }
+        }
+
+        for(uint64_t j = 0; j < span; j++){
+            prime[first + 2*j - lo] = !((bits[j >> 6] >> (j & 63)) & 1);
+        }
+    }
+
+    for(uint64_t n = lo; n < hi && n < odd; n++){
+        prime[n-lo] = 0;// lo, if even
+    }
+    for(uint64_t n = odd+1; n < hi; n += 2){
+        prime[n-lo] = n == 2;
+    }
+    if(lo <= 1 && 1 < hi){
+        prime[1-lo] = 0;
+    }
+    if(lo <= 2 && 2 < hi){
+        prime[2-lo] = 1;
+    }
+}
+
+/**
+ * Whether n is a perfect square, from its square root taken a bit pair at
+ * a time from the top.
+ */
+
+template<int L>
+static bool is_square(const wide<L>& n)
+{
+    wide<L> x = n, root(0), bit(0), t;
+    const int top = (n.bits()-1) & ~1;
+    bit.limb[top/64] = 1ULL << (top%64);
+
+    while(!(bit == wide<L>(0))){
+        wide_add(t, root, bit);
+        root = wide_shr(root, 1);
+        if(!(x < t)){
+            wide_sub(x, x, t);
+            wide_add(root, root, bit);
+        }
+        bit = wide_shr(bit, 2);
+    }
+    return x == wide<L>(0);
+}
+
+/**
+ * gaIIsPrimeStrongFermat() for n of L limbs and a < n.
+ */
+
+template<int L>
+static int gaIIsPrimeStrongFermat(const montgomery_wide<L>& m, uint64_t a)
+{
+    wide<L>       nm1;
+    wide_sub(nm1, m.n, wide<L>(1));
+    const int     s        = nm1.ctz();
+    const wide<L> d        = wide_shr(nm1, s);
+    const wide<L> x        = m.to(wide<L>(a));
+    const wide<L> minusOne = m.sub(wide<L>(0), m.one);
+    wide<L>       y        = x;
+
+    for(int i = d.bits()-2; i >= 0; i--){
+        y = m.mul(y, y);
+        if(d.bit(i)){
+            y = m.mul(y, x);
+        }
+    }
+
+    if(y == m.one || y == minusOne){
+        return 1;
+    }
+    for(int r = 0; r < s-1; r++){
+        y = m.mul(y, y);
+        if(y == m.one){
+            return 0;
+        }else if(y == minusOne){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * gaIIsPrimeStrongLucas() for n of L limbs, step for step; see the steps in
+ * primality-test-baseline.c.
+ */
+
+template<int L>
+static int gaIIsPrimeStrongLucas(const montgomery_wide<L>& m)
+{
+    const wide<L>& n = m.n;
+
+    /* 1. Perfect squares, found by a square root rather than a list. */
+    if(is_square(n)){
+        return 0;
+    }
+
+    /**
+     * 2. The first D in 5, -7, 9, -11, ... with (D/n) = -1, taking (D/n) to
+     *    (n mod |D| / |D|) by reciprocity.
+     */
+
+    uint64_t  a    = 5;
+    int       sign = 1;
+    const int n4   = (int)(n.limb[0] & 3);
+    while(1){
+        int J = gaIJacobiSymbol(n.mod(a), a);
+        if((sign < 0 && n4 == 3) != (a%4 == 3 && n4 == 3)){
+            J = -J;
+        }
+        if     (J ==  0){return 0;}
+        else if(J == -1){break;}
+        a   += 2;
+        sign = -sign;
+    }
+
+    /* 3. K = n+1, which cannot wrap: 2^64L-1 is a multiple of 3. */
+    wide<L> K;
+    wide_add(K, n, wide<L>(1));
+
+    /* 4.-5. From the top bit of K, U = V = 1, in Montgomery form. */
+    wide<L> D = m.to(wide<L>(a));
+    if(sign < 0){
+        D = m.sub(wide<L>(0), D);
+    }
+    wide<L> U = m.one, V = m.one;
+
+    /* 6. */
+    for(int i = K.bits()-2; i >= 0; i--){
+        const wide<L> Ut = m.mul(U, V);
+        const wide<L> Vt = m.avg(m.mul(V, V), m.mul(D, m.mul(U, U)));
+        if(K.bit(i)){
+            U = m.avg(Ut, Vt);
+            V = m.avg(Vt, m.mul(D, Ut));
+        }else{
+            U = Ut;
+            V = Vt;
+        }
+    }
+
+    /* 7. */
+    return U == wide<L>(0);
+}
+
+template<int L>
+int gaIIsPrime(const wide<L>& n)
+{
+    if(n.narrow()){
+        return gaIIsPrime(n.limb[0]);
+    }
+    if(~n.limb[0] & 1){
+        return 0;
+    }
+
+    // the primes 3 to 79, three products of them at a time
+    static const uint64_t products[3] = {3ULL*5*7*11*13*17*19*23, 29ULL*31*37*41*43*47,
+                                         53ULL*59*61*67*71*73*79};
+    static const uint64_t primes[21]  = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37,
+                                         41, 43, 47, 53, 59, 61, 67, 71, 73, 79};
+    for(int i = 0, j = 0; i < 3; i++){
+        const uint64_t x = n.mod(products[i]);
+        for(; j < 21 && products[i] % primes[j] == 0; j++){
+            if(x % primes[j] == 0){
+                return 0;
+            }
+        }
+    }
+
+    montgomery_wide<L> m(n);
+    return gaIIsPrimeStrongFermat(m, 2) && gaIIsPrimeStrongLucas(m);
+}
+
+template int gaIIsPrime(const wide128& n);
+template int gaIIsPrime(const wide256& n);
@@ -0,0 +1,102 @@
+/*
+ * Fork-join worker threads for the products inside one test.
+ */
+
+/* Includes */
+#include "../include/chebyshev-pool.h"
+
+
+chebyshev_pool::chebyshev_pool(unsigned threads)
+{
+    if(threads == 0){
+        threads = std::thread::hardware_concurrency();
+    }
+    for(unsigned t = 1; t < threads; t++){
+        workers.push_back(std::thread(&chebyshev_pool::work, this));
+    }
+}
+
+chebyshev_pool::~chebyshev_pool()
+{
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        stop = true;
+    }
+    wake.notify_all();
+    for(size_t t = 0; t < workers.size(); t++){
+        workers[t].join();
+    }
+}
+
+/**
+ * Runs parts of the current job until none are left to take, and counts
+ * them off; the last to finish tells run(). Parts are taken under the lock
+ * with the job they belong to, so a worker that comes late to one job can
+ * only ever run parts of the job in progress.
+ */
+
+void chebyshev_pool::take()
+{
+    std::unique_lock<std::mutex> hold(lock);
+
+    while(next < count){
+        const chebyshev_task_fn task    = this->task;
+        void* const             context = this->context;
+        const size_t            i       = next++;
+
+        hold.unlock();
+        task(context, i);
+        hold.lock();
+
+        if(--left == 0){
+            done.notify_all();
+        }
+    }
+}
+
+void chebyshev_pool::work()
+{
+    uint64_t seen = 0;
+
+    for(;;){
+        {
+            std::unique_lock<std::mutex> hold(lock);
+            while(job == seen && !stop){
+                wake.wait(hold);
+            }
+            if(stop){
+                return;
+            }
+            seen = job;
+        }
+        take();
+    }
+}
+
+void chebyshev_pool::run(chebyshev_task_fn task, void* context, size_t count)
+{
+    if(workers.empty() || count < 2){
+        for(size_t i = 0; i < count; i++){
+            task(context, i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        this->task    = task;
+        this->context = context;
+        this->count   = count;
+        left          = count;
+        next          = 0;
+        job++;
+    }
+    wake.notify_all();
+
+    take();
+
+    std::unique_lock<std::mutex> hold(lock);
+    while(left){
+        done.wait(hold);
+    }
+}
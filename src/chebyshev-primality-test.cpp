@@ -1,76 +1,362 @@
-#include <iostream>
 #include <vector>
-#include "../include/benchmark.h"
-#include "../include/primality-test-baseline.h"
+#include "../include/chebyshev-big.h"
+#include "../include/chebyshev-primality-test.h"
+#include "../include/chebyshev-ring.h"
 
 using namespace std;
 
-typedef struct polynomial
+/**
+ * Largest r isprime_chebyshev() picks for n < 2^64, the last of its PRIMES.
+ * Past 64 bits chebyshev_select() goes on to larger primes where it must.
+ */
+
+static const uint64_t CHEBYSHEV_MAX_R = 173;
+
+/**
+ * Every r up to this one gets its own compile-time specialization of the
+ * polynomial and matrix code; larger r share the run-time sized one. The
+ * build sets it with -DCHEBYSHEV_MAX_SPECIALIZED_R to bound binary size.
+ */
+
+#ifndef CHEBYSHEV_MAX_SPECIALIZED_R
+#define CHEBYSHEV_MAX_SPECIALIZED_R 173
+#endif
+
+/**
+ * The bits of n and its residue mod a small s, for the engines and
+ * congruent_to_x_n() to take n either as a word or as a wide<L>.
+ */
+
+static inline int      top_bit(uint64_t n)             {return 63-gaIClz(n);}
+static inline bool     bit    (uint64_t n, int i)      {return (n >> i) & 1;}
+static inline uint64_t mod    (uint64_t n, uint64_t s) {return n % s;}
+
+template<int L> static inline int      top_bit(const wide<L>& n)             {return n.bits()-1;}
+template<int L> static inline bool     bit    (const wide<L>& n, int i)      {return n.bit(i);}
+template<int L> static inline uint64_t mod    (const wide<L>& n, uint64_t s) {return n.mod(s);}
+
+/**
+ * Window size for a sliding-window power with a b-bit exponent: the k that
+ * minimizes the 2^(k-1) precomputed odd powers plus about b/(k+1) window
+ * multiplies.
+ */
+
+static int window_bits(int b)
+{
+    int k = 1;
+    while((1 << k) + b/(k+2) < (1 << (k-1)) + b/(k+1)){
+        k++;
+    }
+    return k;
+}
+
+/**
+ * Computes Tn(x) mod (x^r - 1, n) in Montgomery form by raising the
+ * companion matrix of the recurrence T_{k+1} = 2x T_k - T_{k-1},
+ *
+ *     | 2x  -1 |
+ *     |  1   0 |
+ *
+ * to the power n-1 and applying it to (T_1, T_0) = (x, 1).
+ *
+ * The power is taken with a sliding window: odd powers of the base up to
+ * 2^k-1 are precomputed, and each run of up to k bits of n-1 that starts and
+ * ends with a 1 costs one dense multiply instead of one per set bit.
+ */
+
+template<uint64_t R>
+static polynomial<R> chebyshev_matrix(uint64_t n, uint64_t r,
+                                      const montgomery& mont, const ntt_plan* ntt)
 {
-    polynomial(uint64_t r, uint64_t n) : n(n), p(r) {}
-    uint64_t          n;
-    std::vector <uint64_t> p;
+    matrix<R> poly(r, &mont, ntt);
+    
+    poly.p00()[1] = mont.lift( 2 );
+    poly.p01()[0] = mont.lift(n-1);
+    poly.p10()[0] = mont.unit();
+
+    /* now since we already have the exponent which is n -1
+     * we precompute poly^1, poly^3, ..., poly^(2^k-1) and walk the
+     * exponent from the top bit down, squaring once per bit and
+     * multiplying once per window
+     */
 
-    // implementation using Galois field
-    // Galoid field (x^r)^2x2
-    // Finite field arithmetic for lookup
-    polynomial operator+ (const polynomial& other) {
-        uint64_t r = p.size();
-        polynomial ret(r, n);
-        for (int i=0; i< this->p.size(); i++) {
-            ret.p[i] = gaIAddMod(this->p[i], other.p[i], this->n);
+    const uint64_t e = n-1;
+    const int      k = window_bits(64-gaIClz(e));
+    std::vector <matrix<R>, pooled<matrix<R> > > odd;
+    odd.reserve(1 << (k-1));
+    odd.push_back(poly);
+    if(k > 1){
+        matrix<R> poly2(r, &mont, ntt);
+        poly.square_into(poly2);
+        for(int j = 1; j < 1 << (k-1); j++){
+            odd.push_back(poly);
+            odd[j-1].mul_into(odd[j], poly2);
         }
-        return ret;
     }
-    
-    // this is only there 
-    // because the finite field is the polynomial
-    // is mod x^r -1
-    polynomial operator* (const polynomial& other) {
-        uint64_t r = this->p.size();
-        polynomial ret(r, n);
-        for (int i = 0; i < r; i++) {
-            for (int j = 0; j < r; j++) {
-                 ret.p[(i+j) % r] = gaIAddMod(ret.p[(i+j) % r], gaIMulMod(this->p[i], other.p[j], this->n), this->n);
+
+    // squares and products ping-pong between a and b
+    matrix<R>  a(r, &mont, ntt), b(r, &mont, ntt);
+    matrix<R>* powered = &a;
+    matrix<R>* spare   = &b;
+    bool       first   = true;
+
+    for(int i = 63-gaIClz(e); i >= 0;){
+        if(!((e >> i) & 1)){
+            powered->square_into(*spare);
+            std::swap(powered, spare);
+            i--;
+            continue;
+        }
+
+        // longest window e[i..j] of at most k bits ending in a 1
+        int j = i-k+1 < 0 ? 0 : i-k+1;
+        while(!((e >> j) & 1)){
+            j++;
+        }
+        uint64_t w = (e >> j) & ((2ULL << (i-j)) - 1);
+
+        if(first){
+            *powered = odd[w >> 1];
+            first    = false;
+        }else{
+            for(int bit = i; bit >= j; bit--){
+                powered->square_into(*spare);
+                std::swap(powered, spare);
             }
+            powered->mul_into(*spare, odd[w >> 1]);
+            std::swap(powered, spare);
         }
-        return ret;
+        i = j-1;
     }
-} polynomial;
 
+    // Powered is poly**(n-1);
+    //
+    
+    polynomial<R> v0(r,&mont,ntt), v1(r,&mont,ntt), Tn(r,&mont,ntt);
+    v0.p[1] = mont.unit();// x
+    v1.p[0] = mont.unit();// 1
 
-typedef struct matrix
+    poly_muladd<R>(&Tn.p[0], powered->p00(), &v0.p[0], powered->p01(), &v1.p[0], r, mont, ntt);
+    return Tn;
+}
+
+/**
+ * Computes Tn(x) mod (x^r - 1, n) in Montgomery form like chebyshev_matrix(),
+ * but scans n-1 from the top bit down. The accumulator is squared on every
+ * bit and multiplied by the base matrix itself on 1 bits. The base has only
+ * three nonzero coefficients, so that product is the O(r) matrix::mul_base()
+ * and only the squares are dense.
+ */
+
+template<uint64_t R>
+static polynomial<R> chebyshev_matrix_sparse(uint64_t n, uint64_t r,
+                                             const montgomery& mont, const ntt_plan* ntt)
 {
-    matrix(uint64_t r, uint64_t n) : n(n), p00(r,n), p01(r,n), p10(r,n), p11(r,n) {}
-    
-    uint64_t   n;
-    polynomial p00;
-    polynomial p01;
-    polynomial p10;
-    polynomial p11;
+    const uint64_t e = n-1;
+    matrix<R>  a(r, &mont, ntt), b(r, &mont, ntt);
+    matrix<R>* powered = &a;
+    matrix<R>* spare   = &b;
+
+    // the top bit of n-1 leaves the base itself
+    a.p00()[1] = mont.lift( 2 );
+    a.p01()[0] = mont.lift(n-1);
+    a.p10()[0] = mont.unit();
+
+    for(int i = 62-gaIClz(e); i >= 0; i--){
+        powered->square_into(*spare);
+        if((e >> i) & 1){
+            spare->mul_base_into(*powered);
+        }else{
+            std::swap(powered, spare);
+        }
+    }
+
+    // Tn = p00*x + p01*1, again just a shift
+    polynomial<R> Tn(r, &mont, ntt);
+    for(uint64_t k = 0; k < r; k++){
+        Tn.p[k] = mont.add(powered->p00()[k ? k-1 : r-1], powered->p01()[k]);
+    }
+    return Tn;
+}
+
+/**
+ * Computes Tn(x) mod (x^r - 1, n) in Montgomery form with a ladder on the
+ * pair (T_k, T_{k+1}), scanning the bits of n from the top. The doubling
+ * identities
+ *
+ *     T_{2k}   = 2 T_k^2 - 1
+ *     T_{2k+1} = 2 T_k T_{k+1} - x
+ *     T_{2k+2} = 2 T_{k+1}^2 - 1
+ *
+ * step to (T_{2k}, T_{2k+1}) on a 0 bit and to (T_{2k+1}, T_{2k+2}) on a 1
+ * bit, for one square and one product per bit.
+ */
+
+template<uint64_t R, typename M, typename N>
+static polynomial<R, M> chebyshev_ladder(const N& n, uint64_t r,
+                                         const M& mont, const ntt_plan* ntt)
+{
+    polynomial<R, M> Tk(r, &mont, ntt), Tk1(r, &mont, ntt);
+    Tk .p[0] = mont.unit();// T_0 = 1
+    Tk1.p[1] = mont.unit();// T_1 = x
 
-    // | p00 p01 | * | q00 q01 | = | p00*q00+p01*q10 p00*q01+p01q11 |
-    // | p10 p11 |   | q10 q11 |   | p10*q00+p11*q10 p10*q01+p11q11 |
+    polynomial<R, M> cross(r, &mont, ntt), sq(r, &mont, ntt);
 
-    // operator for fast exponentiation
-    matrix operator* (const matrix& other){
-        uint64_t r = p00.p.size();
-        matrix ret(r, n);
-        ret.p00 = this->p00*other.p00 + this->p01*other.p10;
-        ret.p01 = this->p00*other.p01 + this->p01*other.p11;
-        ret.p10 = this->p10*other.p00 + this->p11*other.p10;
-        ret.p11 = this->p10*other.p01 + this->p11*other.p11;
-        return ret;
+    for(int i = top_bit(n); i >= 0; i--){
+        const bool one = bit(n, i);
+        Tk.mul_into(cross, Tk1);
+        (one ? Tk1 : Tk).square_into(sq);
+
+        // 2*cross - x and 2*sq - 1
+        for(uint64_t j = 0; j < r; j++){
+            cross.p[j] = mont.dbl(cross.p[j]);
+            sq   .p[j] = mont.dbl(sq   .p[j]);
+        }
+        cross.p[1] = mont.sub(cross.p[1], mont.unit());
+        sq   .p[0] = mont.sub(sq   .p[0], mont.unit());
+
+        if(one){
+            Tk .p.swap(cross.p);
+            Tk1.p.swap(sq   .p);
+        }else{
+            Tk .p.swap(sq   .p);
+            Tk1.p.swap(cross.p);
+        }
+    }
+
+    return Tk;
+}
+
+/**
+ * Tells whether Tn, given in the Montgomery form of mont, is x^n (mod x^r - 1).
+ */
+
+template<uint64_t R, typename M, typename N>
+static bool congruent_to_x_n(const polynomial<R, M>& Tn, const N& n, uint64_t r, const M& mont)
+{
+    // Is Tn === x^n (mod x^r - 1)
+    // This means
+    //   1) Tn.p[n % r ] == 1
+    //   2) Tn.p[others] == 0
+    //
+    // Montgomery form maps residues one to one, with 1 and 0 going to
+    // mont.unit() and 0, so the coefficients are compared without from().
+
+    typedef typename M::word word;
+    const uint64_t k = mod(n, r);
+
+    for(uint64_t i = 0; i < r; i++){
+        if(Tn.p[i] != (i == k ? mont.unit() : zero_word<word>())){
+            return false;
+        }
     }
 
-} matrix;
+    return true;
+}
+
+/**
+ * Checks whether Tn(x) = x^n (mod x^r - 1, n) for an r picked by
+ * isprime_chebyshev(), with polynomials of compile-time size R (or run-time
+ * size r when R is 0).
+ */
 
-bool isprime_chebyshev(uint64_t n)
+template<uint64_t R>
+static bool chebyshev_congruence(uint64_t n, uint64_t r, chebyshev_engine engine)
+{
+    /*
+     * All coefficient arithmetic from here on is done in Montgomery form,
+     * so the engines convert their inputs on entry and Tn on exit. Below
+     * 2^32 the ladder works on 32-bit words.
+     */
+
+    if(engine == CHEBYSHEV_LADDER && n >> 32 == 0){
+        montgomery32 mont(n);
+        polynomial<R, montgomery32> Tn = chebyshev_ladder<R>(n, r, mont, NULL);
+        return congruent_to_x_n(Tn, n, r, mont);
+    }
+
+    /*
+     * r <= CHEBYSHEV_MAX_R is far below where an ntt_plan pays off, see
+     * BM_matrix_mul, so no plan is passed; chebyshev-big.h is where n gets
+     * large enough for the NTT.
+     */
+
+    montgomery    mont(n);
+    polynomial<R> Tn = engine == CHEBYSHEV_MATRIX        ? chebyshev_matrix       <R>(n, r, mont, NULL) :
+                       engine == CHEBYSHEV_MATRIX_SPARSE ? chebyshev_matrix_sparse<R>(n, r, mont, NULL) :
+                                                           chebyshev_ladder       <R>(n, r, mont, (const ntt_plan*)NULL);
+    return congruent_to_x_n(Tn, n, r, mont);
+}
+
+/**
+ * chebyshev_congruence() for n of L limbs. Only the ladder is built on
+ * montgomery_wide, so the engine is not consulted.
+ */
+
+template<uint64_t R, int L>
+static bool chebyshev_congruence(wide<L> n, uint64_t r, chebyshev_engine)
+{
+    montgomery_wide<L>                 mont(n);
+    polynomial<R, montgomery_wide<L> > Tn = chebyshev_ladder<R>(n, r, mont, (const ntt_plan*)NULL);
+    return congruent_to_x_n(Tn, n, r, mont);
+}
+
+template<typename N>
+using chebyshev_congruence_fn = bool (*)(N n, uint64_t r, chebyshev_engine engine);
+
+#define CHEBYSHEV_SPECIALIZE(R) \
+    case R: return &chebyshev_congruence<(R) <= CHEBYSHEV_MAX_SPECIALIZED_R ? (R) : 0>;
+
+/**
+ * Maps a run-time r to the chebyshev_congruence() for n of type N
+ * specialized for it.
+ */
+
+template<typename N>
+static chebyshev_congruence_fn<N> chebyshev_dispatch(uint64_t r)
+{
+    switch(r){
+        CHEBYSHEV_SPECIALIZE(  3) CHEBYSHEV_SPECIALIZE(  5) CHEBYSHEV_SPECIALIZE(  7)
+        CHEBYSHEV_SPECIALIZE( 11) CHEBYSHEV_SPECIALIZE( 13) CHEBYSHEV_SPECIALIZE( 17)
+        CHEBYSHEV_SPECIALIZE( 19) CHEBYSHEV_SPECIALIZE( 23) CHEBYSHEV_SPECIALIZE( 29)
+        CHEBYSHEV_SPECIALIZE( 31) CHEBYSHEV_SPECIALIZE( 37) CHEBYSHEV_SPECIALIZE( 41)
+        CHEBYSHEV_SPECIALIZE( 43) CHEBYSHEV_SPECIALIZE( 47) CHEBYSHEV_SPECIALIZE( 53)
+        CHEBYSHEV_SPECIALIZE( 59) CHEBYSHEV_SPECIALIZE( 61) CHEBYSHEV_SPECIALIZE( 67)
+        CHEBYSHEV_SPECIALIZE( 71) CHEBYSHEV_SPECIALIZE( 73) CHEBYSHEV_SPECIALIZE( 79)
+        CHEBYSHEV_SPECIALIZE( 83) CHEBYSHEV_SPECIALIZE( 89) CHEBYSHEV_SPECIALIZE( 97)
+        CHEBYSHEV_SPECIALIZE(101) CHEBYSHEV_SPECIALIZE(103) CHEBYSHEV_SPECIALIZE(107)
+        CHEBYSHEV_SPECIALIZE(109) CHEBYSHEV_SPECIALIZE(113) CHEBYSHEV_SPECIALIZE(127)
+        CHEBYSHEV_SPECIALIZE(131) CHEBYSHEV_SPECIALIZE(137) CHEBYSHEV_SPECIALIZE(139)
+        CHEBYSHEV_SPECIALIZE(149) CHEBYSHEV_SPECIALIZE(151) CHEBYSHEV_SPECIALIZE(157)
+        CHEBYSHEV_SPECIALIZE(163) CHEBYSHEV_SPECIALIZE(167) CHEBYSHEV_SPECIALIZE(173)
+        default: return &chebyshev_congruence<0>;
+    }
+}
+
+#undef CHEBYSHEV_SPECIALIZE
+
+/**
+ * The primes r is picked from, in order, padded out with 255s (never read
+ * as primes) so that chebyshev_selector::next() steps whole vectors.
+ */
+
+static const uint8_t PRIMES[CHEBYSHEV_SELECTOR_WIDTH] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 
+                                                         37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 
+                                                         79, 83, 89, 97, 101, 103, 107, 109, 113,
+                                                         127, 131, 137, 139, 149, 151, 157, 163, 
+                                                         167, 173,
+                                                         255, 255, 255, 255, 255, 255, 255, 255,
+                                                         255, 255, 255, 255, 255, 255, 255, 255,
+                                                         255, 255, 255, 255, 255, 255, 255, 255,
+                                                         255};
+
+/**
+ * Settles n outright where it can and otherwise picks its r: returns 1 or 0
+ * for prime or composite, or -1, with r set, when the congruence decides.
+ */
+
+static int chebyshev_select(uint64_t n, uint64_t& r)
 {   
-    // we asssume that the prime is false
-    // at first
-    bool result = false;
-    
     if( n<2){return false;}
     if( n<4){return true;}
     if(~n&1){return false;}
@@ -86,20 +372,15 @@ bool isprime_chebyshev(uint64_t n)
      * This gives a time complexity of O∼(log3 n). return result;
      */
 
-    const int PRIMES[] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 
-                          37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 
-                          79, 83, 89, 97, 101, 103, 107, 109, 113,
-                          127, 131, 137, 139, 149, 151, 157, 163, 
-                          167, 173};
     uint64_t s, x;
-    for (int i=0; i < sizeof(PRIMES)/sizeof(*PRIMES); i++){
+    for (int i=0; i < CHEBYSHEV_PRIMES; i++){
         s = PRIMES[i];
         if(  n   == s){return true;}
         if(n % s == 0){return false;}
         x = n % s;
         if(x*x % s != 1){break;}
     }
-    const uint64_t r = s;
+    r = s;
 
     /* 
      * We have selected the r that satisfies the conditions above. 
@@ -110,90 +391,203 @@ bool isprime_chebyshev(uint64_t n)
      * if and only if Tn(x) \eq x^n(mod x^r−1,n)
      */
 
-    matrix poly(r, n);
-    
-    poly.p00.p[1] =  2 ;
-    poly.p01.p[0] = n-1;
-    poly.p10.p[0] =  1 ;
+    return -1;
+}
 
-    /* now since we already have the exponent which is n -1
-     * now we could just do fast exponentiation
-     * square the matrix, then check if the n-1 is 
-     * shifting integer to the right
-     * if it's 
-     */
-    
-    matrix powered(r, n);
+bool isprime_chebyshev(uint64_t n, chebyshev_engine engine)
+{
+    uint64_t r;
+    int      decided = chebyshev_select(n, r);
 
-    /**
-     * Initialize powered to an 
-     * Identity matrix 
-     */
+    return decided >= 0 ? decided : chebyshev_dispatch<uint64_t>(r)(n, r, engine);
+}
 
-    powered.p00.p[0] = 1;
-    powered.p11.p[0] = 1;
-   
-    // fast exponentiation starts here 
-    // see gaIMod in Olexa's code
-    
-    x = n-1;
+/**
+ * chebyshev_select() for n of L limbs, or a bignum, n >= 2^64. PRIMES runs out when
+ * n^2 = 1 mod every one of them, i.e. their product, about 2^225.6, divides
+ * n^2 - 1, which takes n > 2^112. The search then goes on through the
+ * primes past 173; n^2 - 1 < 2^128L caps it at r = 197 for wide128 and
+ * r = 383 for wide256, and at r of about 5700 for 4096 bits.
+ */
+
+template<typename N>
+static int chebyshev_select(const N& n, uint64_t& r)
+{
+    if(~n.limb[0]&1){return false;}
 
-    while(x){
-        if(x & 1){
-            // 
-            powered = powered*poly;
+    for(uint64_t i = 0, s = PRIMES[0];; s = ++i < CHEBYSHEV_PRIMES ? PRIMES[i] : s+2){
+        if(i >= CHEBYSHEV_PRIMES && !gaIIsPrime(s)){
+            continue;
+        }
+
+        const uint64_t x = n.mod(s);
+        if(x == 0){return false;}
+        if(x != 1 && x != s-1){
+            r = s;
+            return -1;
         }
-        poly = poly*poly;
-        x >>= 1;
     }
+}
 
-    // Powered is poly**(n-1);
-    //
-    
-    polynomial v0(r,n), v1(r,n);
-    v0.p[1] = 1;// x
-    v1.p[0] = 1;// 1
+template<int L>
+bool isprime_chebyshev(const wide<L>& n)
+{
+    if(n.narrow()){
+        return isprime_chebyshev(n.limb[0]);
+    }
 
-    polynomial Tn = powered.p00*v0 + powered.p01*v1;
+    uint64_t r;
+    int      decided = chebyshev_select(n, r);
 
-    // Is Tn === x^n (mod x^r - 1)
-    // This means
-    //   1) Tn.p[n % r ] == 1
-    //   2) Tn.p[others] == 0
-    //
+    return decided >= 0 ? decided : chebyshev_dispatch<wide<L> >(r)(n, r, CHEBYSHEV_LADDER);
+}
 
-    for(int i=0; i<r; i++){
-        if(i == n%r){
-            if(Tn.p[i] != 1){
-                return false;
+template bool isprime_chebyshev(const wide128& n);
+template bool isprime_chebyshev(const wide256& n);
+
+bool isprime_chebyshev_big(const uint64_t* n, size_t limbs, chebyshev_engine engine, chebyshev_pool* pool)
+{
+    const bignum N(n, limbs);
+
+    if(N.size() <= 2){
+        wide128 x(0);
+        std::copy(N.limb.begin(), N.limb.end(), x.limb);
+        return N.size() <= 1 ? isprime_chebyshev(x.limb[0], engine) : isprime_chebyshev(x);
+    }
+    if(N.size() <= 4){
+        wide256 x(0);
+        std::copy(N.limb.begin(), N.limb.end(), x.limb);
+        return isprime_chebyshev(x);
+    }
+
+    uint64_t r;
+    int      decided = chebyshev_select(N, r);
+
+    return decided >= 0 ? decided : chebyshev_congruence_big(N, r, engine, pool);
+}
+
+chebyshev_selector::chebyshev_selector(uint64_t n) : n(n)
+{
+    for(int i = 0; i < CHEBYSHEV_SELECTOR_WIDTH; i++){
+        residue[i] = n % PRIMES[i];
+    }
+}
+
+void chebyshev_selector::next()
+{
+    n++;
+    for(int i = 0; i < CHEBYSHEV_SELECTOR_WIDTH; i++){
+        const uint8_t x = residue[i]+1;
+        residue[i] = x == PRIMES[i] ? 0 : x;
+    }
+}
+
+int chebyshev_selector::select(uint64_t& r) const
+{
+    if( n<2){return false;}
+    if( n<4){return true;}
+    if(~n&1){return false;}
+
+    // as in chebyshev_select(), where for prime s, x^2 = 1 (mod s) iff x = +-1
+    uint64_t s;
+    for(int i = 0; i < CHEBYSHEV_PRIMES; i++){
+        s = PRIMES[i];
+        if(residue[i] == 0){return n == s;}
+        if(residue[i] != 1 && residue[i] != s-1){break;}
+    }
+    r = s;
+    return -1;
+}
+
+/**
+ * Decides the n of a batch that the r search left open, rs[i] being their
+ * r, or 0 for the n already decided in out.
+ */
+
+static void chebyshev_congruence_batch(const uint64_t* n, size_t count, const uint8_t* rs, uint8_t* out)
+{
+    /*
+     * Sort the undecided n by r, counting sort style: first[r] ends up
+     * where bucket r starts in order.
+     */
+
+    std::vector<size_t>  order(count);
+    size_t               first[CHEBYSHEV_MAX_R+2] = {0};
+
+    for(size_t i = 0; i < count; i++){
+        first[rs[i]+1]++;
+    }
+    for(uint64_t r = 1; r <= CHEBYSHEV_MAX_R; r++){
+        first[r] += first[r-1];
+    }
+    for(size_t i = 0; i < count; i++){
+        order[first[rs[i]]++] = i;
+    }
+
+    /*
+     * first[r] now points past bucket r. Within a bucket the n the lockstep
+     * ladder takes go SIMD_LADDER_LANES at a time, the last group padded
+     * with copies of its first n; the rest share one dispatched congruence.
+     */
+
+    for(uint64_t r = 1, i = first[0]; r <= CHEBYSHEV_MAX_R; i = first[r++]){
+        const chebyshev_congruence_fn<uint64_t> congruence = i < first[r] ? chebyshev_dispatch<uint64_t>(r) : NULL;
+        size_t                                  lane[SIMD_LADDER_LANES];
+        uint64_t                                lanes[SIMD_LADDER_LANES];
+        int                                     k = 0;
+
+        for(; i < first[r]; i++){
+            const size_t j = order[i];
+
+            if(simd_chebyshev52 && r <= SIMD_LADDER_MAX_R && n[j] < SIMD_IFMA_MAX_N){
+                lane [k  ] = j;
+                lanes[k++] = n[j];
+            }else{
+                out[j] = congruence(n[j], r, CHEBYSHEV_LADDER);
             }
-        }else{
-            if(Tn.p[i] != 0){
-                return false;
+
+            if(k == SIMD_LADDER_LANES || (k && i+1 == first[r])){
+                for(int l = k; l < SIMD_LADDER_LANES; l++){
+                    lanes[l] = lanes[0];
+                }
+
+                unsigned prime = simd_chebyshev52(lanes, r);
+                for(int l = 0; l < k; l++){
+                    out[lane[l]] = (prime >> l) & 1;
+                }
+                k = 0;
             }
         }
-
-        //if(Tn.p[i] == (i == n%r)){
-        //    return false;
-        //}
     }
-
-    return true;
 }
 
-static void BM_chebyshev(benchmark::State& state) {
+void isprime_chebyshev_batch(const uint64_t* n, size_t count, uint8_t* out)
+{
+    std::vector<uint8_t> rs(count);
+
+    for(size_t i = 0; i < count; i++){
+        uint64_t r;
+        int      decided = chebyshev_select(n[i], r);
 
-  for (auto _ : state) {
-    bool prime = isprime_chebyshev(state.range(0));
-    bool sanity_test = gaIIsPrime(state.range(0));
-    state.counters["IS PRIME"] = prime; 
-    if (sanity_test != prime) {
-        std::cout << "Sanity check failed for " << state.range(0) << "\n";
-        break;
+        out[i] = decided > 0;
+        rs [i] = decided < 0 ? r : 0;
     }
-  }
-  state.SetComplexityN(state.range(0));
+    chebyshev_congruence_batch(n, count, rs.data(), out);
 }
 
-BENCHMARK(BM_chebyshev)->DenseRange(1, std::stol(std::getenv("MAX_INT_CHEBYSHEV") ) )->Complexity();
-BENCHMARK_MAIN();
+void isprime_chebyshev_range(uint64_t lo, size_t count, uint8_t* out)
+{
+    std::vector<uint64_t> n(count);
+    std::vector<uint8_t>  rs(count);
+    chebyshev_selector    selector(lo);
+
+    for(size_t i = 0; i < count; i++, selector.next()){
+        uint64_t r;
+        int      decided = selector.select(r);
+
+        n  [i] = selector.n;
+        out[i] = decided > 0;
+        rs [i] = decided < 0 ? r : 0;
+    }
+    chebyshev_congruence_batch(n.data(), count, rs.data(), out);
+}
@@ -0,0 +1,439 @@
+/*
+ * Vector cyclic-product kernels, compiled per target and picked at run time.
+ */
+
+/* Includes */
+#include <immintrin.h>
+#include "../include/chebyshev-simd.h"
+
+
+/**
+ * Both kernels extend b to bb[j] = b[j mod r] for j < 2r+7, so that
+ *
+ *     out[k+l] = sum_i a[i] bb[k+l-i+r]
+ *
+ * and the lanes l of a block of outputs starting at k read consecutive
+ * words of bb for every i.
+ */
+
+template<typename T>
+static void extend(T* bb, const T* b, uint64_t r){
+    for(uint64_t j=0, i=0; j<2*r+7; j++, i = i+1 == r ? 0 : i+1){
+        bb[j] = b[i];
+    }
+}
+
+
+/**
+ * AVX2: four outputs per block. Each 64-bit product is split into 32-bit
+ * halves summed apart, which cannot carry for r < 2^32.
+ */
+
+__attribute__((target("avx2")))
+static void mul_cyclic32_avx2(uint32_t* out, const uint32_t* a, const uint32_t* b,
+                              uint64_t r, const montgomery& m){
+    uint32_t     bb[2*SIMD_MAX_R+8];
+    const __m256i low = _mm256_set1_epi64x(0xFFFFFFFF);
+
+    extend(bb, b, r);
+
+    for(uint64_t k=0;k<r;k+=4){
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+
+        for(uint64_t i=0;i<r;i++){
+            __m256i x = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)&bb[k-i+r]));
+            __m256i p = _mm256_mul_epu32(x, _mm256_set1_epi64x(a[i]));
+            lo = _mm256_add_epi64(lo, _mm256_and_si256 (p, low));
+            hi = _mm256_add_epi64(hi, _mm256_srli_epi64(p, 32));
+        }
+
+        uint64_t L[4], H[4];
+        _mm256_storeu_si256((__m256i*)L, lo);
+        _mm256_storeu_si256((__m256i*)H, hi);
+        for(uint64_t l=0;l<4 && k+l<r;l++){
+            out[k+l] = m.redc(((unsigned __int128)H[l] << 32) + L[l]);
+        }
+    }
+}
+
+
+/**
+ * AVX-512F: the same with eight outputs per block, which covers the common
+ * r < 8 in one.
+ */
+
+__attribute__((target("avx512f")))
+static void mul_cyclic32_avx512(uint32_t* out, const uint32_t* a, const uint32_t* b,
+                                uint64_t r, const montgomery& m){
+    uint32_t     bb[2*SIMD_MAX_R+8];
+    const __m512i low = _mm512_set1_epi64(0xFFFFFFFF);
+
+    extend(bb, b, r);
+
+    for(uint64_t k=0;k<r;k+=8){
+        __m512i lo = _mm512_setzero_si512();
+        __m512i hi = _mm512_setzero_si512();
+
+        for(uint64_t i=0;i<r;i++){
+            __m512i x = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)&bb[k-i+r]));
+            __m512i p = _mm512_mul_epu32(x, _mm512_set1_epi64(a[i]));
+            lo = _mm512_add_epi64(lo, _mm512_and_si512 (p, low));
+            hi = _mm512_add_epi64(hi, _mm512_srli_epi64(p, 32));
+        }
+
+        uint64_t L[8], H[8];
+        _mm512_storeu_si512(L, lo);
+        _mm512_storeu_si512(H, hi);
+        for(uint64_t l=0;l<8 && k+l<r;l++){
+            out[k+l] = m.redc(((unsigned __int128)H[l] << 32) + L[l]);
+        }
+    }
+}
+
+
+/**
+ * AVX-512 IFMA: eight outputs per block. madd52lo/hi sum the low and high
+ * 52 bits of each 104-bit product apart; neither sum carries for r < 2^12.
+ */
+
+__attribute__((target("avx512f,avx512ifma")))
+static void mul_cyclic52_ifma(uint64_t* out, const uint64_t* a, const uint64_t* b,
+                              uint64_t r, const montgomery& m){
+    uint64_t bb[2*SIMD_MAX_R+8];
+
+    extend(bb, b, r);
+
+    for(uint64_t k=0;k<r;k+=8){
+        __m512i lo = _mm512_setzero_si512();
+        __m512i hi = _mm512_setzero_si512();
+
+        for(uint64_t i=0;i<r;i++){
+            __m512i x = _mm512_loadu_si512(&bb[k-i+r]);
+            __m512i y = _mm512_set1_epi64(a[i]);
+            lo = _mm512_madd52lo_epu64(lo, x, y);
+            hi = _mm512_madd52hi_epu64(hi, x, y);
+        }
+
+        uint64_t L[8], H[8];
+        _mm512_storeu_si512(L, lo);
+        _mm512_storeu_si512(H, hi);
+        for(uint64_t l=0;l<8 && k+l<r;l++){
+            out[k+l] = m.redc(((unsigned __int128)H[l] << 52) + L[l]);
+        }
+    }
+}
+
+
+/**
+ * FMA: double precision, for hosts without IFMA, with n < 2^50. Residues
+ * are exact doubles, an FMA splits a product exactly into x y = h + l, and
+ * with q = round(h/n)
+ *
+ *     $$x y \equiv (h - q n) + l \pmod n$$
+ *
+ * where h - q n is formed exactly by another FMA. q may be one off, so a
+ * term lies within 1.5n of 0, and four of them plus a running sum that was
+ * brought within n of 0 stay below 2^53 in magnitude: the running sum is
+ * folded back the same way every four terms. The sum of Montgomery forms,
+ * reduced mod n, then takes one redc().
+ *
+ * Values below 2^52 convert to and from doubles through the bits of 2^52.
+ */
+
+__attribute__((target("avx2,fma")))
+static void mul_cyclic52_fma_avx2(uint64_t* out, const uint64_t* a, const uint64_t* b,
+                                  uint64_t r, const montgomery& m){
+    double        bb[2*SIMD_MAX_R+8], aa[SIMD_MAX_R], bd[SIMD_MAX_R];
+    const __m256d n    = _mm256_set1_pd((double)m.n);
+    const __m256d ninv = _mm256_set1_pd(1.0/(double)m.n);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d big  = _mm256_set1_pd(4503599627370496.0);// 2^52
+
+    for(uint64_t i=0;i<r;i++){
+        aa[i] = (double)a[i];
+        bd[i] = (double)b[i];
+    }
+    extend(bb, bd, r);
+
+    for(uint64_t k=0;k<r;k+=4){
+        __m256d acc = _mm256_setzero_pd();
+
+        for(uint64_t i=0;i<r;i++){
+            __m256d x = _mm256_loadu_pd(&bb[k-i+r]);
+            __m256d y = _mm256_set1_pd(aa[i]);
+            __m256d h = _mm256_mul_pd(x, y);
+            __m256d l = _mm256_fmsub_pd(x, y, h);
+            __m256d q = _mm256_round_pd(_mm256_mul_pd(h, ninv), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            acc = _mm256_add_pd(acc, _mm256_add_pd(_mm256_fnmadd_pd(q, n, h), l));
+
+            if((i&3) == 3 || i+1 == r){
+                q   = _mm256_round_pd(_mm256_mul_pd(acc, ninv), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+                acc = _mm256_fnmadd_pd(q, n, acc);
+            }
+        }
+        acc = _mm256_add_pd(acc, _mm256_and_pd(_mm256_cmp_pd(acc, zero, _CMP_LT_OQ), n));
+
+        uint64_t S[4];
+        _mm256_storeu_si256((__m256i*)S, _mm256_xor_si256(_mm256_castpd_si256(_mm256_add_pd(acc, big)),
+                                                          _mm256_castpd_si256(big)));
+        for(uint64_t l=0;l<4 && k+l<r;l++){
+            out[k+l] = m.redc(S[l]);
+        }
+    }
+}
+
+
+/**
+ * AVX-512F: the same with eight outputs per block.
+ */
+
+__attribute__((target("avx512f")))
+static void mul_cyclic52_fma_avx512(uint64_t* out, const uint64_t* a, const uint64_t* b,
+                                    uint64_t r, const montgomery& m){
+    double        bb[2*SIMD_MAX_R+8], aa[SIMD_MAX_R], bd[SIMD_MAX_R];
+    const __m512d n    = _mm512_set1_pd((double)m.n);
+    const __m512d ninv = _mm512_set1_pd(1.0/(double)m.n);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d big  = _mm512_set1_pd(4503599627370496.0);// 2^52
+
+    for(uint64_t i=0;i<r;i++){
+        aa[i] = (double)a[i];
+        bd[i] = (double)b[i];
+    }
+    extend(bb, bd, r);
+
+    for(uint64_t k=0;k<r;k+=8){
+        __m512d acc = _mm512_setzero_pd();
+
+        for(uint64_t i=0;i<r;i++){
+            __m512d x = _mm512_loadu_pd(&bb[k-i+r]);
+            __m512d y = _mm512_set1_pd(aa[i]);
+            __m512d h = _mm512_mul_pd(x, y);
+            __m512d l = _mm512_fmsub_pd(x, y, h);
+            __m512d q = _mm512_roundscale_pd(_mm512_mul_pd(h, ninv), _MM_FROUND_TO_NEAREST_INT);
+            acc = _mm512_add_pd(acc, _mm512_add_pd(_mm512_fnmadd_pd(q, n, h), l));
+
+            if((i&3) == 3 || i+1 == r){
+                q   = _mm512_roundscale_pd(_mm512_mul_pd(acc, ninv), _MM_FROUND_TO_NEAREST_INT);
+                acc = _mm512_fnmadd_pd(q, n, acc);
+            }
+        }
+        acc = _mm512_mask_add_pd(acc, _mm512_cmp_pd_mask(acc, zero, _CMP_LT_OQ), acc, n);
+
+        uint64_t S[8];
+        _mm512_storeu_si512(S, _mm512_xor_si512(_mm512_castpd_si512(_mm512_add_pd(acc, big)),
+                                                _mm512_castpd_si512(big)));
+        for(uint64_t l=0;l<8 && k+l<r;l++){
+            out[k+l] = m.redc(S[l]);
+        }
+    }
+}
+
+
+/**
+ * AVX-512 IFMA lockstep ladder: one modulus per lane, coefficients in
+ * Montgomery form with R = 2^52, one vector per coefficient.
+ *
+ * Products sum their low and high 52 bits apart, as in mul_cyclic52_ifma().
+ * A sum t < r n^2 is reduced by
+ *
+ *     $$(t + m n)/R, \quad m = -t n^{-1} \bmod R,$$
+ *
+ * which is below (r+1)n, and then by conditional subtractions of 16n, 8n,
+ * ..., n, enough for r <= SIMD_LADDER_MAX_R.
+ */
+
+typedef struct lanes52
+{
+    __m512i n;
+    __m512i ninv;           /* -n^-1 mod 2^52 */
+    __m512i one;            /* R mod n */
+    __m512i multiple[5];    /* 16n, 8n, 4n, 2n, n */
+} lanes52;
+
+__attribute__((target("avx512f,avx512ifma"), always_inline))
+static inline __m512i redc52(const lanes52& m, __m512i lo, __m512i hi){
+    const __m512i low = _mm512_set1_epi64((1ULL << 52) - 1);
+
+    __m512i h = _mm512_add_epi64(hi, _mm512_srli_epi64(lo, 52));
+    __m512i l = _mm512_and_si512(lo, low);
+    __m512i q = _mm512_madd52lo_epu64(_mm512_setzero_si512(), l, m.ninv);
+    __m512i t = _mm512_madd52hi_epu64(h, q, m.n);
+
+    /* the low halves of t and q n add up to R unless both are 0 */
+    t = _mm512_mask_add_epi64(t, _mm512_test_epi64_mask(l, l), t, _mm512_set1_epi64(1));
+
+    for(int i=0;i<5;i++){
+        t = _mm512_mask_sub_epi64(t, _mm512_cmpge_epu64_mask(t, m.multiple[i]), t, m.multiple[i]);
+    }
+    return t;
+}
+
+__attribute__((target("avx512f,avx512ifma"), always_inline))
+static inline __m512i add52(const lanes52& m, __m512i a, __m512i b){
+    __m512i s = _mm512_add_epi64(a, b);
+    return _mm512_mask_sub_epi64(s, _mm512_cmpge_epu64_mask(s, m.n), s, m.n);
+}
+
+__attribute__((target("avx512f,avx512ifma"), always_inline))
+static inline __m512i sub52(const lanes52& m, __m512i a, __m512i b){
+    __m512i d = _mm512_sub_epi64(a, b);
+    return _mm512_mask_add_epi64(d, _mm512_cmplt_epu64_mask(a, b), d, m.n);
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+static void mul_cyclic52_lanes(__m512i* out, const __m512i* a, const __m512i* b,
+                               uint64_t r, const lanes52& m){
+    for(uint64_t k=0;k<r;k++){
+        __m512i lo = _mm512_setzero_si512();
+        __m512i hi = _mm512_setzero_si512();
+
+        for(uint64_t i=0, j=k; i<r; i++, j = j ? j-1 : r-1){
+            lo = _mm512_madd52lo_epu64(lo, a[i], b[j]);
+            hi = _mm512_madd52hi_epu64(hi, a[i], b[j]);
+        }
+        out[k] = redc52(m, lo, hi);
+    }
+}
+
+/**
+ * For odd r, the terms a[i] a[j] of out[k], i+j = k mod r, pair up around
+ * the one i = k/2 mod r, so a square takes about half the products.
+ */
+
+__attribute__((target("avx512f,avx512ifma")))
+static void sqr_cyclic52_lanes(__m512i* out, const __m512i* a, uint64_t r, const lanes52& m){
+    for(uint64_t k=0;k<r;k++){
+        const uint64_t h  = k&1 ? (k+r)/2 : k/2;
+        __m512i        lo = _mm512_setzero_si512();
+        __m512i        hi = _mm512_setzero_si512();
+
+        for(uint64_t d=1, i=h+1, j=h-1; d<=r/2; d++, i++, j--){
+            if(i == r){i = 0;}
+            if(j+1 == 0){j = r-1;}
+            lo = _mm512_madd52lo_epu64(lo, a[i], a[j]);
+            hi = _mm512_madd52hi_epu64(hi, a[i], a[j]);
+        }
+        lo = _mm512_madd52lo_epu64(_mm512_slli_epi64(lo, 1), a[h], a[h]);
+        hi = _mm512_madd52hi_epu64(_mm512_slli_epi64(hi, 1), a[h], a[h]);
+        out[k] = redc52(m, lo, hi);
+    }
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+static unsigned chebyshev52_ifma(const uint64_t* n, uint64_t r){
+    uint64_t ninv[SIMD_LADDER_LANES], one[SIMD_LADDER_LANES], nmodr[SIMD_LADDER_LANES];
+    uint64_t all = 0;
+    lanes52  m;
+
+    for(int l=0;l<SIMD_LADDER_LANES;l++){
+        uint64_t inv = n[l];
+        for(int i=0;i<5;i++){
+            inv *= 2 - n[l]*inv;
+        }
+        ninv [l] = (0-inv) & ((1ULL << 52) - 1);
+        one  [l] = (1ULL << 52) % n[l];
+        nmodr[l] = n[l] % r;
+        all     |= n[l];
+    }
+    m.n    = _mm512_loadu_si512(n);
+    m.ninv = _mm512_loadu_si512(ninv);
+    m.one  = _mm512_loadu_si512(one);
+    for(int i=0;i<5;i++){
+        m.multiple[i] = _mm512_slli_epi64(m.n, 4-i);
+    }
+
+    __m512i Tk[SIMD_LADDER_MAX_R], Tk1[SIMD_LADDER_MAX_R], s[SIMD_LADDER_MAX_R];
+    __m512i cross[SIMD_LADDER_MAX_R], sq[SIMD_LADDER_MAX_R];
+
+    for(uint64_t j=0;j<r;j++){
+        Tk[j] = Tk1[j] = _mm512_setzero_si512();
+    }
+    Tk [0] = m.one;// T_0 = 1
+    Tk1[1] = m.one;// T_1 = x
+
+    for(int i = 63-gaIClz(all); i >= 0; i--){
+        const __mmask8 bit = _mm512_test_epi64_mask(m.n, _mm512_set1_epi64(1ULL << i));
+
+        mul_cyclic52_lanes(cross, Tk, Tk1, r, m);
+        for(uint64_t j=0;j<r;j++){
+            s[j] = _mm512_mask_blend_epi64(bit, Tk[j], Tk1[j]);
+        }
+        sqr_cyclic52_lanes(sq, s, r, m);
+
+        // 2*cross - x and 2*sq - 1, then the new pair by each lane's bit
+        for(uint64_t j=0;j<r;j++){
+            cross[j] = add52(m, cross[j], cross[j]);
+            sq   [j] = add52(m, sq   [j], sq   [j]);
+        }
+        cross[1] = sub52(m, cross[1], m.one);
+        sq   [0] = sub52(m, sq   [0], m.one);
+
+        for(uint64_t j=0;j<r;j++){
+            Tk [j] = _mm512_mask_blend_epi64(bit, sq   [j], cross[j]);
+            Tk1[j] = _mm512_mask_blend_epi64(bit, cross[j], sq   [j]);
+        }
+    }
+
+    // Tn = x^n: coefficient n mod r is 1, the others 0
+    const __m512i e  = _mm512_loadu_si512(nmodr);
+    __mmask8      ok = 0xFF;
+    for(uint64_t j=0;j<r;j++){
+        __m512i c = redc52(m, Tk[j], _mm512_setzero_si512());
+        __m512i x = _mm512_maskz_mov_epi64(_mm512_cmpeq_epi64_mask(e, _mm512_set1_epi64(j)),
+                                           _mm512_set1_epi64(1));
+        ok &= _mm512_cmpeq_epi64_mask(c, x);
+    }
+    return ok;
+}
+
+
+/**
+ * Kernel Selection
+ */
+
+static simd_mul_cyclic32_fn select_mul_cyclic32(){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") ? &mul_cyclic32_avx512 :
+           __builtin_cpu_supports("avx2")    ? &mul_cyclic32_avx2   : NULL;
+}
+
+static simd_mul_cyclic52_fn select_mul_cyclic52_fma(){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") ? &mul_cyclic52_fma_avx512 :
+           __builtin_cpu_supports("avx2") &&
+           __builtin_cpu_supports("fma")     ? &mul_cyclic52_fma_avx2   : NULL;
+}
+
+static simd_mul_cyclic52_fn select_mul_cyclic52(){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512ifma") ? &mul_cyclic52_ifma : select_mul_cyclic52_fma();
+}
+
+static simd_chebyshev52_fn select_chebyshev52(){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512ifma") ? &chebyshev52_ifma : NULL;
+}
+
+const simd_mul_cyclic32_fn simd_mul_cyclic32 = select_mul_cyclic32();
+const simd_mul_cyclic52_fn simd_mul_cyclic52 = select_mul_cyclic52();
+const simd_mul_cyclic52_fn simd_mul_cyclic52_fma = select_mul_cyclic52_fma();
+const simd_chebyshev52_fn  simd_chebyshev52  = select_chebyshev52();
+
+const char* simd_mul_cyclic32_kernel(){
+    return simd_mul_cyclic32 == &mul_cyclic32_avx512 ? "avx512f" :
+           simd_mul_cyclic32 == &mul_cyclic32_avx2   ? "avx2"    : "scalar";
+}
+
+const char* simd_mul_cyclic52_kernel(){
+    return simd_mul_cyclic52 == &mul_cyclic52_ifma       ? "avx512ifma" :
+           simd_mul_cyclic52 == &mul_cyclic52_fma_avx512 ? "avx512f-fma" :
+           simd_mul_cyclic52 == &mul_cyclic52_fma_avx2   ? "avx2-fma"   : "scalar";
+}
+
+const char* simd_chebyshev52_kernel(){
+    return simd_chebyshev52  == &chebyshev52_ifma    ? "avx512ifma" : "scalar";
+}
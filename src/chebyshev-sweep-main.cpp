@@ -0,0 +1,100 @@
+/*
+ * chebyshev-sweep [-c] lo hi [threads]
+ *
+ * Prints the primes in [lo, hi) in increasing order, one per line, and
+ * the totals and rate of the sweep on stderr. With -c, every result is
+ * also checked against a prime_oracle, and mismatches are reported.
+ */
+
+/* Includes */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../include/chebyshev-oracle.h"
+#include "../include/chebyshev-primality-test.h"
+
+
+/**
+ * Numbers the check gathers before asking the oracle about them, so that
+ * it sieves long runs rather than single chunks.
+ */
+
+static const uint64_t CHECK_SPAN = 1ULL << 22;
+
+typedef struct sweep_check
+{
+    explicit sweep_check(uint64_t hi) : oracle(hi), lo(0), mismatches(0) {}
+
+    prime_oracle         oracle;
+    uint64_t             lo;        /* first number in results */
+    std::vector<uint8_t> results, truth;
+    uint64_t             mismatches;
+} sweep_check;
+
+static void check_results(sweep_check& check)
+{
+    const uint64_t count = check.results.size();
+
+    check.truth.resize(count);
+    check.oracle.range(check.lo, check.lo + count, &check.truth[0]);
+    for(uint64_t i = 0; i < count; i++){
+        if(check.results[i] != check.truth[i]){
+            fprintf(stderr, "Sanity check failed for %llu\n", (unsigned long long)(check.lo + i));
+            check.mismatches++;
+        }
+    }
+    check.lo += count;
+    check.results.clear();
+}
+
+static void print_primes(uint64_t lo, const uint8_t* prime, size_t count, void* context)
+{
+    for(size_t i = 0; i < count; i++){
+        if(prime[i]){
+            printf("%llu\n", (unsigned long long)(lo + i));
+        }
+    }
+
+    if(sweep_check* check = (sweep_check*)context){
+        if(check->results.empty()){
+            check->lo = lo;
+        }
+        check->results.insert(check->results.end(), prime, prime + count);
+        if(check->results.size() >= CHECK_SPAN){
+            check_results(*check);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const bool checking = argc > 1 && strcmp(argv[1], "-c") == 0;
+    argc -= checking;
+    argv += checking;
+
+    if(argc < 3){
+        fprintf(stderr, "usage: %s [-c] lo hi [threads]\n", argv[-checking]);
+        return 1;
+    }
+
+    const uint64_t lo      = strtoull(argv[1], NULL, 0);
+    const uint64_t hi      = strtoull(argv[2], NULL, 0);
+    const unsigned threads = argc > 3 ? strtoul(argv[3], NULL, 0) : 0;
+    sweep_check*   check   = checking ? new sweep_check(hi) : NULL;
+
+    chebyshev_sweep_stats stats = chebyshev_sweep(lo, hi, threads, print_primes, check);
+
+    fprintf(stderr, "%llu numbers, %llu primes, %u threads, %.3f s: %.0f numbers/s\n",
+            (unsigned long long)stats.numbers, (unsigned long long)stats.primes,
+            stats.threads, stats.seconds, stats.seconds > 0 ? stats.numbers/stats.seconds : 0.0);
+
+    if(check){
+        check_results(*check);
+        fprintf(stderr, "%llu mismatches against the oracle\n", (unsigned long long)check->mismatches);
+        const bool failed = check->mismatches != 0;
+        delete check;
+        return failed;
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Work-stealing sweep of isprime_chebyshev_range() over a range.
+ */
+
+/* Includes */
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/chebyshev-primality-test.h"
+
+
+/**
+ * Numbers per chunk, the unit a thread takes or steals: enough to fill the
+ * lanes of isprime_chebyshev_range() many times over for every r.
+ */
+
+static const uint64_t SWEEP_CHUNK  = 4096;
+
+/**
+ * Chunks per thread in a window. A window's results are handed to emit in
+ * order before the next window starts, which holds the results in memory
+ * to threads * SWEEP_WINDOW * SWEEP_CHUNK bytes.
+ */
+
+static const uint64_t SWEEP_WINDOW = 16;
+
+
+/**
+ * The chunks of the current window a thread has yet to take, [begin, end).
+ * Its owner takes from the front, thieves from the back.
+ */
+
+typedef struct sweep_run
+{
+    std::mutex lock;
+    uint64_t   begin = 0;
+    uint64_t   end   = 0;
+} sweep_run;
+
+typedef struct sweep
+{
+    explicit sweep(uint64_t lo, uint64_t hi, unsigned threads)
+        : lo(lo), hi(hi), runs(threads), prime(threads*SWEEP_WINDOW*SWEEP_CHUNK) {}
+
+    const uint64_t         lo, hi;
+    uint64_t               first = 0;       /* first chunk of the window */
+    std::vector<sweep_run> runs;
+    std::vector<uint8_t>   prime;           /* results of the window */
+
+    std::mutex              lock;           /* guards the fields below */
+    std::condition_variable wake, done;
+    uint64_t                window = 0;     /* bumped to start a window */
+    unsigned                busy   = 0;     /* threads still in it */
+    bool                    stop   = false;
+} sweep;
+
+/**
+ * Takes the next chunk of thread self, stealing when its run is empty.
+ * Returns false once every run of the window is.
+ */
+
+static bool sweep_take(sweep& s, unsigned self, uint64_t& chunk)
+{
+    {
+        std::lock_guard<std::mutex> hold(s.runs[self].lock);
+        if(s.runs[self].begin < s.runs[self].end){
+            chunk = s.runs[self].begin++;
+            return true;
+        }
+    }
+
+    for(;;){
+        unsigned victim = self;
+        uint64_t most   = 0;
+        for(unsigned t = 0; t < s.runs.size(); t++){
+            std::lock_guard<std::mutex> hold(s.runs[t].lock);
+            if(s.runs[t].end - s.runs[t].begin > most){
+                most   = s.runs[t].end - s.runs[t].begin;
+                victim = t;
+            }
+        }
+        if(most == 0){
+            return false;
+        }
+
+        uint64_t begin, end;
+        {
+            std::lock_guard<std::mutex> hold(s.runs[victim].lock);
+            sweep_run& run = s.runs[victim];
+            if(run.begin == run.end){
+                continue;// taken meanwhile, look again
+            }
+            end       = run.end;
+            begin     = run.end - (run.end - run.begin + 1)/2;
+            run.end   = begin;
+        }
+
+        std::lock_guard<std::mutex> hold(s.runs[self].lock);
+        s.runs[self].begin = begin+1;
+        s.runs[self].end   = end;
+        chunk = begin;
+        return true;
+    }
+}
+
+static void sweep_thread(sweep& s, unsigned self)
+{
+    uint64_t window = 0;
+
+    for(;;){
+        {
+            std::unique_lock<std::mutex> hold(s.lock);
+            while(s.window == window && !s.stop){
+                s.wake.wait(hold);
+            }
+            if(s.stop){
+                return;
+            }
+            window = s.window;
+        }
+
+        uint64_t chunk;
+        while(sweep_take(s, self, chunk)){
+            const uint64_t lo    = s.lo + chunk*SWEEP_CHUNK;
+            const uint64_t count = s.hi - lo < SWEEP_CHUNK ? s.hi - lo : SWEEP_CHUNK;
+
+            isprime_chebyshev_range(lo, count, &s.prime[(chunk - s.first)*SWEEP_CHUNK]);
+        }
+
+        std::lock_guard<std::mutex> hold(s.lock);
+        if(--s.busy == 0){
+            s.done.notify_one();
+        }
+    }
+}
+
+chebyshev_sweep_stats chebyshev_sweep(uint64_t lo, uint64_t hi, unsigned threads,
+                                      chebyshev_sweep_fn emit, void* context)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    chebyshev_sweep_stats                       stats = {0, 0, 0, 0.0};
+
+    if(hi <= lo){
+        return stats;
+    }
+    if(threads == 0){
+        threads = std::thread::hardware_concurrency();
+        threads = threads ? threads : 1;
+    }
+
+    const uint64_t           chunks = (hi - lo)/SWEEP_CHUNK + ((hi - lo) % SWEEP_CHUNK != 0);
+    sweep                    s(lo, hi, threads);
+    std::vector<std::thread> pool;
+    for(unsigned t = 0; t < threads; t++){
+        pool.push_back(std::thread(sweep_thread, std::ref(s), t));
+    }
+
+    for(uint64_t first = 0; first < chunks; first += threads*SWEEP_WINDOW){
+        const uint64_t last = chunks - first < threads*SWEEP_WINDOW ? chunks : first + threads*SWEEP_WINDOW;
+
+        // deal the window out in one contiguous run per thread
+        s.first = first;
+        for(unsigned t = 0; t < threads; t++){
+            std::lock_guard<std::mutex> hold(s.runs[t].lock);
+            s.runs[t].begin = first + (last - first)* t   /threads;
+            s.runs[t].end   = first + (last - first)*(t+1)/threads;
+        }
+        {
+            std::unique_lock<std::mutex> hold(s.lock);
+            s.busy = threads;
+            s.window++;
+            s.wake.notify_all();
+            while(s.busy){
+                s.done.wait(hold);
+            }
+        }
+
+        for(uint64_t chunk = first; chunk < last; chunk++){
+            const uint64_t from  = lo + chunk*SWEEP_CHUNK;
+            const uint64_t count = hi - from < SWEEP_CHUNK ? hi - from : SWEEP_CHUNK;
+            const uint8_t* prime = &s.prime[(chunk - first)*SWEEP_CHUNK];
+
+            for(uint64_t i = 0; i < count; i++){
+                stats.primes += prime[i];
+            }
+            if(emit){
+                emit(from, prime, count, context);
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> hold(s.lock);
+        s.stop = true;
+        s.wake.notify_all();
+    }
+    for(unsigned t = 0; t < threads; t++){
+        pool[t].join();
+    }
+
+    stats.numbers = hi - lo;
+    stats.threads = threads;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
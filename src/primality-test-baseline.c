@@ -15,6 +15,18 @@
 #define GA_USING_MALLOC_FOR_VLA 1
 #endif
 
+/* Detect when kernels can be picked per host, through GCC's ifunc. */
+#if (__GNUC__ >= 5) && defined(__x86_64__) && defined(__ELF__) && defined(__SIZEOF_INT128__)
+#define GA_USING_KERNEL_DISPATCH 1
+#endif
+
+/* Force the small arithmetic helpers inline where GCC's attribute exists. */
+#if __GNUC__ >= 4
+#define GAI_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define GAI_ALWAYS_INLINE
+#endif
+
 
 /* Defines */
 #define GA_IS_COMPOSITE      0
@@ -54,36 +66,36 @@ int      gaIClz       (uint64_t n){
 #endif
 }
 
-uint64_t gaIAddMod    (uint64_t a, uint64_t b, uint64_t m){
-	a %= m;
-	b %= m;
+/**
+ * Sum, difference and half-sum of a, b already in [0, m). The wrap-around,
+ * being data dependent, is added back through a mask rather than a branch.
+ * The functions after them reduce their inputs first; the *Ctx ones do not.
+ */
 
-	if(m-a > b){
-		return a+b;
-	}else{
-		return a+b-m;
-	}
+static inline uint64_t gaIAddModReduced(uint64_t a, uint64_t b, uint64_t m){
+	return a-(m-b) + (m & (0-(uint64_t)(a < m-b)));
 }
 
-uint64_t gaISubMod    (uint64_t a, uint64_t b, uint64_t m){
-	a %= m;
-	b %= m;
+static inline uint64_t gaISubModReduced(uint64_t a, uint64_t b, uint64_t m){
+	return a-b + (m & (0-(uint64_t)(a < b)));
+}
 
-	if(a >= b){
-		return a-b;
-	}else{
-		return a-b+m;
-	}
+static inline uint64_t gaIAvgModReduced(uint64_t a, uint64_t b, uint64_t m){
+	uint64_t s = gaIAddModReduced(a,b,m);
+
+	return (s>>1) + (((m>>1)+(m&1)) & (0-(s&1)));
 }
 
-uint64_t gaIAvgMod    (uint64_t a, uint64_t b, uint64_t m){
-	uint64_t s = gaIAddMod(a,b,m);
+uint64_t gaIAddMod    (uint64_t a, uint64_t b, uint64_t m){
+	return gaIAddModReduced(a%m, b%m, m);
+}
 
-	if(s&1){
-		return (s>>1)+(m>>1)+(s&m&1);
-	}else{
-		return s>>1;
-	}
+uint64_t gaISubMod    (uint64_t a, uint64_t b, uint64_t m){
+	return gaISubModReduced(a%m, b%m, m);
+}
+
+uint64_t gaIAvgMod    (uint64_t a, uint64_t b, uint64_t m){
+	return gaIAvgModReduced(a%m, b%m, m);
 }
 
 uint64_t gaIMulMod    (uint64_t a, uint64_t b, uint64_t m){
@@ -252,7 +264,281 @@ int      gaIJacobiSymbol(uint64_t a, uint64_t n){
 	return s*gaIJacobiSymbol(n1,a1);
 }
 
-int      gaIIsPrimeStrongFermat(uint64_t n, uint64_t a){
+/**
+ * Modulus Contexts
+ *
+ * Everything above takes a raw modulus and divides on every call. A
+ * gaIModCtx pays for one 128-by-64-bit divide when it is built, for the
+ * reciprocal of the normalized modulus, and every operation on it after
+ * that is made of multiplications, shifts and conditional subtractions.
+ */
+
+static inline GAI_ALWAYS_INLINE
+uint64_t gaIMulHiLo(uint64_t a, uint64_t b, uint64_t* lo){
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 t = (unsigned __int128)a * b;
+
+	*lo = (uint64_t)t;
+	return (uint64_t)(t >> 64);
+#else
+	uint64_t ah   = a>>32;
+	uint64_t al   = (uint32_t)a;
+	uint64_t bh   = b>>32;
+	uint64_t bl   = (uint32_t)b;
+
+	uint64_t ahbl = ah*bl;
+	uint64_t albl = al*bl;
+	uint64_t md   = ahbl + al*bh;
+	uint64_t hi   = ah*bh + (md>>32);
+
+	*lo = albl + (md<<32);
+	if(*lo < albl){hi++;}
+	if(md  < ahbl){hi+=(uint64_t)1<<32;}
+
+	return hi;
+#endif
+}
+
+/**
+ * The reciprocal of a normalized d (top bit set) of Möller and Granlund,
+ * "Improved division by invariant integers" (2011):
+ *
+ *     $$v = \lfloor (2^{128}-1)/d \rfloor - 2^{64}$$
+ *
+ * which is the quotient of [~d:~0] by d.
+ */
+
+static uint64_t gaIReciprocal(uint64_t d){
+#if (__GNUC__ >= 4) && defined(__x86_64__) && !defined(__STRICT_ANSI__)
+	uint64_t v, r;
+
+	asm(
+	    "div %2\n\t"
+	    : "=a"(v), "=d"(r)      /* Outputs */
+	    : "r"(d), "a"(~(uint64_t)0), "d"(~d)  /* Inputs */
+	    : "cc"
+	);
+
+	return v;
+#elif defined(__SIZEOF_INT128__)
+	return (uint64_t)((((unsigned __int128)~d << 64) | ~(uint64_t)0) / d);
+#else
+	uint64_t hi = ~d, lo = ~(uint64_t)0, v = 0;
+	int      i;
+
+	for(i=0;i<64;i++){
+		uint64_t carry = hi>>63;
+
+		hi = (hi<<1) | (lo>>63);
+		lo <<= 1;
+		v  <<= 1;
+		if(carry || hi >= d){hi -= d;v |= 1;}
+	}
+
+	return v;
+#endif
+}
+
+/**
+ * [u1:u0] / d and [u1:u0] mod d, for a normalized d with reciprocal v and
+ * u1 < d, by Möller and Granlund's Algorithm 4.
+ */
+
+static inline GAI_ALWAYS_INLINE
+uint64_t gaIDiv2by1(uint64_t u1, uint64_t u0, uint64_t d, uint64_t v, uint64_t* r){
+	uint64_t q0, q1;
+
+	q1  = gaIMulHiLo(v, u1, &q0);
+	q0 += u0;
+	q1 += u1 + (q0 < u0) + 1;
+	*r  = u0 - q1*d;
+	if(*r >  q0){q1--;*r += d;}
+	if(*r >= d ){q1++;*r -= d;}
+
+	return q1;
+}
+
+static inline GAI_ALWAYS_INLINE
+uint64_t gaIRem2by1(uint64_t u1, uint64_t u0, uint64_t d, uint64_t v){
+	uint64_t r;
+
+	gaIDiv2by1(u1, u0, d, v, &r);
+	return r;
+}
+
+/**
+ * A product of Montgomery forms, with R = 2^64: for ab < nR, returns
+ * ab/R mod n. It takes the modulus apart so that the Strong Fermat kernels
+ * below can keep n and n^-1 in registers.
+ */
+
+static inline GAI_ALWAYS_INLINE
+uint64_t gaIMontgomeryMul(uint64_t a, uint64_t b, uint64_t n, uint64_t ninv){
+	uint64_t tl, th, ml, mh;
+
+	th = gaIMulHiLo(a,      b, &tl);
+	mh = gaIMulHiLo(tl*ninv, n, &ml);
+
+	return th >= mh ? th-mh : th-mh+n;
+}
+
+void     gaIModCtxInit(gaIModCtx* ctx, uint64_t n){
+	int i;
+
+	ctx->n     = n;
+	ctx->shift = gaIClz(n);
+	ctx->v     = gaIReciprocal(n << ctx->shift);
+
+	/* Newton's iteration doubles the number of correct low bits each step. */
+	ctx->ninv = n;
+	for(i=0;i<5;i++){
+		ctx->ninv *= 2 - n*ctx->ninv;
+	}
+
+	/* 2^64 - n = R mod n */
+	ctx->one = gaIModCtxReduce(ctx, 0-n);
+	ctx->r2  = gaIMulModCtx   (ctx, ctx->one, ctx->one);
+}
+
+uint64_t gaIModCtxReduce(const gaIModCtx* ctx, uint64_t a){
+	const int s = ctx->shift;
+
+	return gaIRem2by1(s ? a >> (64-s) : 0, a << s, ctx->n << s, ctx->v) >> s;
+}
+
+uint64_t gaIAddModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b){
+	return gaIAddModReduced(a, b, ctx->n);
+}
+
+uint64_t gaISubModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b){
+	return gaISubModReduced(a, b, ctx->n);
+}
+
+uint64_t gaIAvgModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b){
+	return gaIAvgModReduced(a, b, ctx->n);
+}
+
+uint64_t gaIMulModCtx (const gaIModCtx* ctx, uint64_t a, uint64_t b){
+	const int s = ctx->shift;
+	uint64_t  hi, lo;
+
+	/* a < n makes hi < n, so the shifted high word stays below n << s. */
+	hi = gaIMulHiLo(a, b, &lo);
+	if(s){
+		hi = (hi << s) | (lo >> (64-s));
+		lo <<= s;
+	}
+
+	return gaIRem2by1(hi, lo, ctx->n << s, ctx->v) >> s;
+}
+
+void     gaIShoupInit (gaIShoup* s, const gaIModCtx* ctx, uint64_t w){
+	uint64_t r;
+
+	/* w < n keeps w << shift below the normalized n. */
+	s->w = w;
+	s->q = gaIDiv2by1(w << ctx->shift, 0, ctx->n << ctx->shift, ctx->v, &r);
+}
+
+uint64_t gaIMulShoupCtx(const gaIModCtx* ctx, uint64_t a, const gaIShoup* s){
+	uint64_t h, l, t;
+
+	/* h is the quotient of a*w by n or one less, so t lies in [0, 2n). */
+	h = gaIMulHiLo(a, s->q, &l);
+	t = a*s->w - h*ctx->n;
+
+	return t >= ctx->n ? t-ctx->n : t;
+}
+
+uint64_t gaIPowModCtx (const gaIModCtx* ctx, uint64_t x, uint64_t a){
+	const uint64_t n = ctx->n;
+	uint64_t       r;
+	int            i;
+
+	/* Same special cases as gaIPowMod(). */
+	if(n<=1){
+		return 0;
+	}
+
+	x = gaIModCtxReduce(ctx, x);
+
+	if(a==0){
+		return 1;
+	}else if(x<=1 || a==1){
+		return x;
+	}
+
+	/**
+	 * Odd moduli square in Montgomery form, left to right; even ones, which
+	 * have no n^-1 mod R, through Barrett products.
+	 */
+
+	if(n&1){
+		x = gaIMontgomeryMul(x, ctx->r2, n, ctx->ninv);
+		r = x;
+		for(i=62-gaIClz(a);i>=0;i--){
+			r = gaIMontgomeryMul(r, r, n, ctx->ninv);
+			if((a>>i)&1){
+				r = gaIMontgomeryMul(r, x, n, ctx->ninv);
+			}
+		}
+
+		return gaIMontgomeryMul(r, 1, n, ctx->ninv);
+	}
+
+	r = 1;
+	while(a){
+		if(a&1){
+			r = gaIMulModCtx(ctx, r, x);
+		}
+
+		x = gaIMulModCtx(ctx, x, x);
+		a >>= 1;
+	}
+
+	return r;
+}
+
+/**
+ * gaIJacobiSymbol() for a < n and n odd, by the binary algorithm: halvings
+ * and subtractions where the former divides at every step.
+ */
+
+static int gaIJacobiSymbolOdd(uint64_t a, uint64_t n){
+	uint64_t t;
+	int      s = 1, e;
+
+	while(a){
+		e  = gaICtz(a);
+		a >>= e;
+		if((e&1) && ((n&7) == 3 || (n&7) == 5)){
+			s = -s;
+		}
+
+		if(a < n){
+			t = a;a = n;n = t;
+			if((a&3) == 3 && (n&3) == 3){
+				s = -s;
+			}
+		}
+
+		a -= n;
+	}
+
+	return n == 1 ? s : 0;
+}
+
+/**
+ * Strong Fermat Kernels
+ *
+ * The test runs in Montgomery form: a residue x is held as xR mod n, and
+ * 1 and -1 become R mod n and n - R mod n. The body is inlined into one
+ * function per target, so that the compiler may use the instructions of
+ * each.
+ */
+
+static inline GAI_ALWAYS_INLINE
+int      gaIIsPrimeStrongFermatMontgomeryBody(const gaIModCtx* ctx, uint64_t a){
 	/**
 	 * The Fermat strong probable prime test the Miller-Rabin test relies upon
 	 * uses integer "witnesses" in an attempt at proving the number composite.
@@ -344,27 +630,36 @@ int      gaIIsPrimeStrongFermat(uint64_t n, uint64_t a){
 	 *     inconclusive. Thus this function returns "probably prime".
 	 */
 
-	uint64_t d, x;
-	int64_t  s, r;
+	const uint64_t n = ctx->n, ninv = ctx->ninv, one = ctx->one, minusOne = n-one;
+	uint64_t       d, x, y;
+	int64_t        s, r;
+	int            i;
 
-	a %= n;
+	a = gaIModCtxReduce(ctx, a);
 	if(a==0){
 		return GA_IS_PROBABLY_PRIME;
 	}
 
+	x  = gaIMontgomeryMul(a, ctx->r2, n, ninv);
 	s  = gaICtz(n-1);
 	d  = (n-1) >> s;
-	x  = gaIPowMod(a,d,n);
+	y  = x;
+	for(i=62-gaIClz(d);i>=0;i--){
+		y = gaIMontgomeryMul(y, y, n, ninv);
+		if((d>>i)&1){
+			y = gaIMontgomeryMul(y, x, n, ninv);
+		}
+	}
 
-	if(x==1 || x==n-1){
+	if(y==one || y==minusOne){
 		return GA_IS_PROBABLY_PRIME;
 	}
 
 	for(r=0;r<s-1;r++){
-		x = gaIMulMod(x,x,n);
-		if(x==1){
+		y = gaIMontgomeryMul(y, y, n, ninv);
+		if(y==one){
 			return GA_IS_COMPOSITE;
-		}else if(x == n-1){
+		}else if(y==minusOne){
 			return GA_IS_PROBABLY_PRIME;
 		}
 	}
@@ -372,9 +667,61 @@ int      gaIIsPrimeStrongFermat(uint64_t n, uint64_t a){
 	return GA_IS_COMPOSITE;
 }
 
-int      gaIIsPrimeStrongLucas(uint64_t n){
-	uint64_t Dp, Dm, D, K, U, Ut, V, Vt;
-	int      J, r, i;
+static int gaIIsPrimeStrongFermatMontgomery(const gaIModCtx* ctx, uint64_t a){
+	return gaIIsPrimeStrongFermatMontgomeryBody(ctx, a);
+}
+
+#if GA_USING_KERNEL_DISPATCH
+
+__attribute__((target("bmi2")))
+static int gaIIsPrimeStrongFermatMontgomeryBMI2(const gaIModCtx* ctx, uint64_t a){
+	return gaIIsPrimeStrongFermatMontgomeryBody(ctx, a);
+}
+
+/**
+ * Kernel Selection
+ *
+ * The dynamic loader calls the resolver once, before relocations are all
+ * applied, so it returns addresses directly rather than read a table.
+ */
+
+static int (*gaIIsPrimeStrongFermatResolve(void))(const gaIModCtx*, uint64_t){
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("bmi2") ? &gaIIsPrimeStrongFermatMontgomeryBMI2 :
+	                                        &gaIIsPrimeStrongFermatMontgomery;
+}
+
+int      gaIIsPrimeStrongFermatCtx(const gaIModCtx* ctx, uint64_t a)
+         __attribute__((ifunc("gaIIsPrimeStrongFermatResolve")));
+
+const char* gaIIsPrimeStrongFermatKernel(void){
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("bmi2") ? "montgomery-bmi2" : "montgomery";
+}
+
+#else
+
+int      gaIIsPrimeStrongFermatCtx(const gaIModCtx* ctx, uint64_t a){
+	return gaIIsPrimeStrongFermatMontgomery(ctx, a);
+}
+
+const char* gaIIsPrimeStrongFermatKernel(void){
+	return "montgomery";
+}
+
+#endif
+
+int      gaIIsPrimeStrongFermat(uint64_t n, uint64_t a){
+	gaIModCtx ctx;
+
+	gaIModCtxInit(&ctx, n);
+	return gaIIsPrimeStrongFermatCtx(&ctx, a);
+}
+
+int      gaIIsPrimeStrongLucasCtx(const gaIModCtx* ctx){
+	const uint64_t n = ctx->n, ninv = ctx->ninv;
+	uint64_t       Dp, Dm, D, K, U, Ut, V, Vt, four;
+	int            J, r, i;
 
 	/**
 	 * FIPS 186-4 C.3.3 (General) Lucas Probabilistic Primality Test
@@ -394,19 +741,20 @@ int      gaIIsPrimeStrongLucas(uint64_t n){
 	 *     Iff Jacobi symbol is 0, return "composite".
 	 */
 
-	Dp = gaIAddMod(0, 5, n);
-	Dm = gaISubMod(0, 7, n);
+	four = gaIModCtxReduce(ctx, 4);
+	Dp   = gaIModCtxReduce(ctx, 5);
+	Dm   = gaISubModCtx(ctx, 0, gaIModCtxReduce(ctx, 7));
 	while(1){
-		J = gaIJacobiSymbol(Dp, n);
+		J = gaIJacobiSymbolOdd(Dp, n);
 		if     (J ==  0){return GA_IS_COMPOSITE;}
 		else if(J == -1){D = Dp;break;}
 
-		J = gaIJacobiSymbol(Dm, n);
+		J = gaIJacobiSymbolOdd(Dm, n);
 		if     (J ==  0){return GA_IS_COMPOSITE;}
 		else if(J == -1){D = Dm;break;}
 
-		Dp = gaIAddMod(Dp, 4, n);
-		Dm = gaISubMod(Dm, 4, n);
+		Dp = gaIAddModCtx(ctx, Dp, four);
+		Dm = gaISubModCtx(ctx, Dm, four);
 	}
 
 	/**
@@ -426,20 +774,29 @@ int      gaIIsPrimeStrongLucas(uint64_t n){
 
 	/**
 	 * 5. Set Ur = 1 and Vr = 1.
+	 *
+	 *     NOTE: U, V and D are held in Montgomery form from here on. Halving
+	 *           is linear, so gaIAvgModCtx() works on that form unchanged,
+	 *           and U0 is 0 in either form.
+	 *
+	 *     NOTE: D is fixed, but as a Shoup multiplier it would still cost
+	 *           three multiplications per product, as Montgomery's does.
 	 */
 
-	U = V = 1;
+	U = V = ctx->one;
+	D = gaIMontgomeryMul(D, ctx->r2, n, ninv);
 
 	/**
 	 * 6. For i=r–1 to 0, do
 	 */
 
 	for(i=r-1;i>=0;i--){
-		Ut = gaIMulMod(U,V,n);
-		Vt = gaIAvgMod(gaIMulMod(V,V,n), gaIMulMod(D,gaIMulMod(U,U,n),n), n);
+		Ut = gaIMontgomeryMul(U,V,n,ninv);
+		Vt = gaIAvgModCtx(ctx, gaIMontgomeryMul(V,V,n,ninv),
+		                       gaIMontgomeryMul(D,gaIMontgomeryMul(U,U,n,ninv),n,ninv));
 		if((K>>i)&1){
-			U = gaIAvgMod(Ut,Vt,n);
-			V = gaIAvgMod(Vt,gaIMulMod(D,Ut,n),n);
+			U = gaIAvgModCtx(ctx, Ut, Vt);
+			V = gaIAvgModCtx(ctx, Vt, gaIMontgomeryMul(D,Ut,n,ninv));
 		}else{
 			U = Ut;
 			V = Vt;
@@ -453,8 +810,16 @@ int      gaIIsPrimeStrongLucas(uint64_t n){
 	return U==0 ? GA_IS_PROBABLY_PRIME : GA_IS_COMPOSITE;
 }
 
+int      gaIIsPrimeStrongLucas(uint64_t n){
+	gaIModCtx ctx;
+
+	gaIModCtxInit(&ctx, n);
+	return gaIIsPrimeStrongLucasCtx(&ctx);
+}
+
 int      gaIIsPrime   (uint64_t n){
 	int            hasNoSmallFactors, hasSmallFactors;
+	gaIModCtx      ctx;
 
 	/**
 	 * Check if it is 2, the oddest prime.
@@ -510,16 +875,18 @@ int      gaIIsPrime   (uint64_t n){
 	 * classified as "probably prime") but they are expected to be enormous.
 	 *
 	 * We begin with the Fermat base-2 strong primality test
-	 * (Miller-Rabin test with one witness only, a=2).
+	 * (Miller-Rabin test with one witness only, a=2). Both tests share one
+	 * modulus context.
 	 */
 
-	return gaIIsPrimeStrongFermat(n,          2) &&
+	gaIModCtxInit(&ctx, n);
+	return gaIIsPrimeStrongFermatCtx(&ctx, 2) &&
 
 	/**
 	 * Assuming this is one of the base-2 Fermat strong probable primes, we run
 	 * the Lucas primality test with Selfridge's Method A for selecting D.
 	 */
 
-	       gaIIsPrimeStrongLucas (n            );
+	       gaIIsPrimeStrongLucasCtx (&ctx   );
 }
 